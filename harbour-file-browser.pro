@@ -1,6 +1,9 @@
 TEMPLATE = subdirs
 SUBDIRS = src
 
+# the benchmarks are built only with "qmake CONFIG+=benchmarks", they are not packaged
+CONFIG(benchmarks): SUBDIRS += tests
+
 # ordered makes sure projects are built in the order specified in SUBDIRS.
 # Usually it makes sense to build tests only if main component can be built
 CONFIG += ordered
@@ -0,0 +1,131 @@
+#include "checksumworker.h"
+#include <QFile>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include "crc32c.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+// bytes read at a time, cancel and progress are checked between the chunks
+static const int ChunkSize = 1024 * 1024;
+// minimum time between progress signals (milliseconds)
+static const int ProgressInterval = 200;
+
+ChecksumWorker::ChecksumWorker(QObject *parent) :
+    QThread(parent),
+    m_generation(0),
+    m_pending(false),
+    m_running(false),
+    m_latestGeneration(0)
+{
+}
+
+ChecksumWorker::~ChecksumWorker()
+{
+}
+
+void ChecksumWorker::startChecksum(QString filename, int generation)
+{
+    bool needStart = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_filename = filename;
+        m_generation = generation;
+        m_pending = true;
+        m_latestGeneration.storeRelease(generation);
+        if (!m_running) {
+            m_running = true;
+            needStart = true;
+        }
+    }
+
+    if (needStart) {
+        wait(); // the thread may still be returning from a previous run
+        start(QThread::LowPriority);
+    }
+}
+
+void ChecksumWorker::cancel()
+{
+    // no request has a negative generation, so the running one becomes stale
+    m_latestGeneration.storeRelease(-1);
+}
+
+void ChecksumWorker::run() Q_DECL_OVERRIDE
+{
+    forever {
+        QString filename;
+        int generation;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_pending) {
+                m_running = false;
+                return;
+            }
+            filename = m_filename;
+            generation = m_generation;
+            m_pending = false;
+        }
+
+        QString result;
+        QString errorMessage = checksum(filename, generation, result);
+        if (!isStale(generation))
+            emit done(generation, result, errorMessage);
+    }
+}
+
+QString ChecksumWorker::checksum(QString filename, int generation, QString &result)
+{
+    int fd = open(QFile::encodeName(filename).constData(), O_RDONLY);
+    if (fd < 0)
+        return QString::fromLocal8Bit(strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return tr("Not a regular file");
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    QByteArray buffer(ChunkSize, Qt::Uninitialized);
+    quint32 crc = 0;
+    qint64 done = 0;
+    QElapsedTimer progressTimer;
+    progressTimer.start();
+    forever {
+        if (isStale(generation)) {
+            close(fd);
+            return QString();
+        }
+
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            int err = errno;
+            close(fd);
+            return QString::fromLocal8Bit(strerror(err));
+        }
+        crc = crc32c(crc, buffer.constData(), n);
+        done += n;
+
+        if (st.st_size > 0 && progressTimer.elapsed() >= ProgressInterval) {
+            emit progressChanged(generation, (int)qMin(100 * done / st.st_size, (qint64)100));
+            progressTimer.restart();
+        }
+    }
+    close(fd);
+
+    result = QString("%1").arg(crc, 8, 16, QChar('0'));
+    return QString();
+}
+
+bool ChecksumWorker::isStale(int generation) const
+{
+    return m_latestGeneration.loadAcquire() != generation;
+}
@@ -0,0 +1,47 @@
+#ifndef CHECKSUMWORKER_H
+#define CHECKSUMWORKER_H
+
+#include <QThread>
+#include <QMutex>
+
+/**
+ * @brief ChecksumWorker calculates the CRC-32C of a file in the background.
+ * The file is read sequentially in large chunks. Progress and the result are sent with the
+ * generation number of the request, a new request makes the running one stale, so it stops.
+ */
+class ChecksumWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit ChecksumWorker(QObject *parent = 0);
+    ~ChecksumWorker();
+
+    // starts calculating the checksum, a running calculation is stopped
+    void startChecksum(QString filename, int generation);
+    void cancel();
+
+signals: // signals, can be connected from a thread to another
+    void progressChanged(int generation, int progress);
+
+    // checksum is 8 hex digits, or empty and error message is set
+    void done(int generation, QString checksum, QString errorMessage);
+
+protected:
+    void run();
+
+private:
+    QString checksum(QString filename, int generation, QString &result);
+    bool isStale(int generation) const;
+
+    QMutex m_mutex; // protects the request members below
+    QString m_filename;
+    int m_generation;
+    bool m_pending;
+    bool m_running;
+
+    // atomic so no locks needed to check for stale requests
+    QAtomicInt m_latestGeneration;
+};
+
+#endif // CHECKSUMWORKER_H
@@ -0,0 +1,137 @@
+#include "commandrunner.h"
+#include <QCoreApplication>
+#include <QTextCodec>
+#include <QTextDecoder>
+
+// commands running at the same time, the rest are queued
+static const int MaxProcesses = 4;
+// bytes read from a process at a time
+static const qint64 ChunkSize = 64 * 1024;
+
+static CommandRunner *s_instance = 0;
+
+CommandRunner *CommandRunner::instance()
+{
+    // the application owns it, so processes are stopped when the application quits
+    if (!s_instance)
+        s_instance = new CommandRunner(QCoreApplication::instance());
+    return s_instance;
+}
+
+CommandRunner::CommandRunner(QObject *parent) :
+    QObject(parent),
+    m_nextId(1)
+{
+}
+
+CommandRunner::~CommandRunner()
+{
+    foreach (const RunningCommand &running, m_running)
+        delete running.decoder;
+    s_instance = 0;
+}
+
+int CommandRunner::start(QString command, QStringList arguments)
+{
+    Command queued;
+    queued.id = m_nextId++;
+    queued.command = command;
+    queued.arguments = arguments;
+    m_queue.append(queued);
+
+    // started later, so the caller can store the id before any signals
+    QMetaObject::invokeMethod(this, "startCommands", Qt::QueuedConnection);
+    return queued.id;
+}
+
+void CommandRunner::startCommands()
+{
+    while (!m_queue.isEmpty() && m_running.count() < MaxProcesses) {
+        Command command = m_queue.takeFirst();
+        QProcess *process = takeProcess();
+
+        RunningCommand running;
+        running.id = command.id;
+        running.decoder = QTextCodec::codecForName("UTF-8")->makeDecoder();
+        m_running.insert(process, running);
+        process->start(command.command, command.arguments);
+    }
+}
+
+QProcess *CommandRunner::takeProcess()
+{
+    if (!m_idleProcesses.isEmpty())
+        return m_idleProcesses.takeLast();
+
+    QProcess *process = new QProcess(this);
+    process->setReadChannel(QProcess::StandardOutput);
+    process->setProcessChannelMode(QProcess::MergedChannels); // merged stderr channel with stdout channel
+    connect(process, SIGNAL(readyReadStandardOutput()), this, SLOT(readOutput()));
+    connect(process, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(handleFinish(int, QProcess::ExitStatus)));
+    connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(handleError(QProcess::ProcessError)));
+    return process;
+}
+
+void CommandRunner::readOutput()
+{
+    QProcess *process = qobject_cast<QProcess*>(sender());
+    if (process)
+        sendOutput(process);
+}
+
+void CommandRunner::sendOutput(QProcess *process)
+{
+    if (!m_running.contains(process))
+        return;
+
+    // everything available is read in chunks and sent at once
+    const RunningCommand &running = m_running[process];
+    QString text;
+    QByteArray chunk;
+    while (!(chunk = process->read(ChunkSize)).isEmpty())
+        text += running.decoder->toUnicode(chunk);
+    if (!text.isEmpty())
+        emit outputReady(running.id, text);
+}
+
+void CommandRunner::handleFinish(int exitCode, QProcess::ExitStatus status)
+{
+    QProcess *process = qobject_cast<QProcess*>(sender());
+    if (!process)
+        return;
+
+    if (status == QProcess::CrashExit) // if it crashed, then use some error exit code
+        exitCode = -99999;
+    recycle(process, exitCode);
+}
+
+void CommandRunner::handleError(QProcess::ProcessError error)
+{
+    // other errors are followed by finished()
+    QProcess *process = qobject_cast<QProcess*>(sender());
+    if (!process || error != QProcess::FailedToStart)
+        return;
+
+    recycle(process, -88888); // if error, then use some error exit code
+}
+
+void CommandRunner::recycle(QProcess *process, int exitCode)
+{
+    if (!m_running.contains(process))
+        return;
+
+    // output left in the buffer is sent before the exit code
+    sendOutput(process);
+
+    RunningCommand running = m_running.take(process);
+    delete running.decoder;
+
+    // the process is started again only after returning from its signal
+    if (m_idleProcesses.count() < MaxProcesses)
+        m_idleProcesses.append(process);
+    else
+        process->deleteLater();
+
+    emit finished(running.id, exitCode);
+    QMetaObject::invokeMethod(this, "startCommands", Qt::QueuedConnection);
+}
@@ -0,0 +1,65 @@
+#ifndef COMMANDRUNNER_H
+#define COMMANDRUNNER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+
+class QTextDecoder;
+
+/**
+ * @brief CommandRunner runs external commands for the whole application.
+ * There is one shared instance owned by the application, so a command keeps running when
+ * the page that started it is closed. At most MaxProcesses commands run at the same time,
+ * others wait in a queue. The QProcess objects of finished commands are reused, so
+ * repeated commands don't accumulate processes or file descriptors.
+ * Commands are identified by the id returned by start(). Output is read in chunks and stderr
+ * is merged to stdout. Exit code -99999 means that the command crashed and -88888 that it
+ * could not be started.
+ */
+class CommandRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    static CommandRunner *instance();
+    ~CommandRunner();
+
+    // queues the command and returns its id
+    int start(QString command, QStringList arguments);
+
+signals:
+    void outputReady(int commandId, QString text);
+    void finished(int commandId, int exitCode);
+
+private slots:
+    void readOutput();
+    void handleFinish(int exitCode, QProcess::ExitStatus status);
+    void handleError(QProcess::ProcessError error);
+    void startCommands();
+
+private:
+    struct Command {
+        int id;
+        QString command;
+        QStringList arguments;
+    };
+    struct RunningCommand {
+        int id;
+        QTextDecoder *decoder; // keeps partial characters between chunks
+    };
+
+    explicit CommandRunner(QObject *parent = 0);
+    QProcess *takeProcess();
+    void sendOutput(QProcess *process);
+    void recycle(QProcess *process, int exitCode);
+
+    int m_nextId;
+    QList<Command> m_queue;
+    QHash<QProcess*, RunningCommand> m_running;
+    QList<QProcess*> m_idleProcesses;
+};
+
+#endif // COMMANDRUNNER_H
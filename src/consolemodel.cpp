@@ -0,0 +1,171 @@
+#include "consolemodel.h"
+
+enum {
+    LineRole = Qt::UserRole + 1
+};
+
+// default maximum size of the kept output (characters)
+static const int DefaultMaxSize = 256 * 1024;
+// longer lines are split to rows, so a single row stays cheap to lay out
+static const int MaxLineLength = 4096;
+
+ConsoleModel::ConsoleModel(QObject *parent) :
+    QAbstractListModel(parent),
+    m_size(0),
+    m_maxSize(DefaultMaxSize),
+    m_lastLineOpen(false),
+    m_truncated(false)
+{
+}
+
+ConsoleModel::~ConsoleModel()
+{
+}
+
+int ConsoleModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return m_lines.count();
+}
+
+QVariant ConsoleModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() > m_lines.size()-1)
+        return QVariant();
+
+    switch (role) {
+
+    case Qt::DisplayRole:
+    case LineRole:
+        return m_lines.at(index.row());
+
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> ConsoleModel::roleNames() const
+{
+    QHash<int, QByteArray> roles = QAbstractListModel::roleNames();
+    roles.insert(LineRole, QByteArray("line"));
+    return roles;
+}
+
+void ConsoleModel::setMaxSize(int maxSize)
+{
+    if (m_maxSize == maxSize)
+        return;
+
+    m_maxSize = maxSize;
+    emit maxSizeChanged();
+    trim();
+}
+
+void ConsoleModel::appendText(const QString &text)
+{
+    if (text.isEmpty())
+        return;
+
+    // split to lines, the part after the last newline is left open
+    QStringList lines = text.split('\n');
+    bool lastLineOpen = !lines.last().isEmpty();
+    if (!lastLineOpen)
+        lines.removeLast();
+
+    // the first part continues the open line
+    int start = 0;
+    if (m_lastLineOpen && !lines.isEmpty()) {
+        QString &last = m_lines.last();
+        int available = MaxLineLength - last.length();
+        if (available > 0) {
+            QString part = lines.first().left(available);
+            last += part;
+            m_size += part.length();
+            lines.first().remove(0, part.length());
+            if (lines.first().isEmpty()) {
+                start = 1;
+                // the open line ended in this chunk
+                if ((lines.count() > 1 || !lastLineOpen) && last.endsWith('\r')) {
+                    last.chop(1);
+                    --m_size;
+                }
+            }
+            QModelIndex index = createIndex(m_lines.count() - 1, 0);
+            emit dataChanged(index, index);
+        }
+    }
+
+    // complete lines are added with one insert, overlong lines become several rows
+    QStringList newLines;
+    for (int i = start; i < lines.count(); ++i) {
+        const QString &line = lines.at(i);
+        if (line.length() <= MaxLineLength) {
+            newLines.append(line);
+            continue;
+        }
+        for (int pos = 0; pos < line.length(); pos += MaxLineLength)
+            newLines.append(line.mid(pos, MaxLineLength));
+    }
+    for (int i = 0; i < newLines.count(); ++i) {
+        QString &line = newLines[i];
+        if (line.endsWith('\r'))
+            line.chop(1);
+        m_size += line.length();
+    }
+
+    if (!newLines.isEmpty()) {
+        beginInsertRows(QModelIndex(), m_lines.count(), m_lines.count() + newLines.count() - 1);
+        m_lines += newLines;
+        endInsertRows();
+    }
+    m_lastLineOpen = lastLineOpen;
+
+    trim();
+    if (!newLines.isEmpty())
+        emit lineCountChanged();
+}
+
+void ConsoleModel::clear()
+{
+    if (m_lines.isEmpty())
+        return;
+
+    beginResetModel();
+    m_lines.clear();
+    m_size = 0;
+    m_lastLineOpen = false;
+    endResetModel();
+    emit lineCountChanged();
+
+    if (m_truncated) {
+        m_truncated = false;
+        emit truncatedChanged();
+    }
+}
+
+void ConsoleModel::trim()
+{
+    if (m_size <= m_maxSize)
+        return;
+
+    // the last line is always kept
+    int count = 0;
+    int removedSize = 0;
+    while (count < m_lines.count() - 1 && m_size - removedSize > m_maxSize) {
+        removedSize += m_lines.at(count).length();
+        ++count;
+    }
+    if (count == 0)
+        return;
+
+    beginRemoveRows(QModelIndex(), 0, count - 1);
+    m_lines.erase(m_lines.begin(), m_lines.begin() + count);
+    m_size -= removedSize;
+    endRemoveRows();
+    emit lineCountChanged();
+
+    if (!m_truncated) {
+        m_truncated = true;
+        emit truncatedChanged();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef CONSOLEMODEL_H
+#define CONSOLEMODEL_H
+
+#include <QAbstractListModel>
+#include <QStringList>
+
+/**
+ * @brief The ConsoleModel class holds the output of a command as a list of lines.
+ * Text is appended in chunks, complete lines become new rows and an unterminated last line
+ * is updated in place, so a view only lays out the changed rows. The oldest lines are
+ * dropped when the text grows over maxSize characters, which bounds the memory used by
+ * commands with a lot of output.
+ */
+class ConsoleModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int lineCount READ lineCount() NOTIFY lineCountChanged())
+    Q_PROPERTY(int maxSize READ maxSize() WRITE setMaxSize(int) NOTIFY maxSizeChanged())
+    Q_PROPERTY(bool truncated READ truncated() NOTIFY truncatedChanged())
+
+public:
+    explicit ConsoleModel(QObject *parent = 0);
+    ~ConsoleModel();
+
+    // methods needed by ListView
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QHash<int, QByteArray> roleNames() const;
+
+    // property accessors
+    int lineCount() const { return m_lines.count(); }
+    int maxSize() const { return m_maxSize; }
+    void setMaxSize(int maxSize);
+    bool truncated() const { return m_truncated; } // true if old lines have been dropped
+
+    // appends a chunk of text, which may end in the middle of a line
+    void appendText(const QString &text);
+    void clear();
+
+signals:
+    void lineCountChanged();
+    void maxSizeChanged();
+    void truncatedChanged();
+
+private:
+    void trim();
+
+    QStringList m_lines; // removing from the front is cheap, so this works as a ring buffer
+    int m_size; // characters in m_lines
+    int m_maxSize;
+    bool m_lastLineOpen; // true if the last line has not ended yet
+    bool m_truncated;
+};
+
+#endif // CONSOLEMODEL_H
@@ -0,0 +1,153 @@
+#include "copyjournal.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <fcntl.h>
+#include <unistd.h>
+
+// journals older than this are removed when a journal is opened (days)
+static const int MaxJournalAge = 7;
+
+static QString journalDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+            "/harbour-file-browser/journal";
+}
+
+static qint64 modifiedNsecs(const struct stat &st)
+{
+    return (qint64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+CopyJournal::CopyJournal() :
+    m_fd(-1)
+{
+}
+
+CopyJournal::~CopyJournal()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool CopyJournal::open(bool move, const QStringList &filenames, const QString &destDirectory)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QDir dir(journalDir());
+    if (!dir.mkpath("."))
+        return false;
+
+    QDateTime oldest = QDateTime::currentDateTime().addDays(-MaxJournalAge);
+    foreach (QFileInfo info, dir.entryInfoList(QDir::Files)) {
+        if (info.lastModified() < oldest)
+            QFile::remove(info.absoluteFilePath());
+    }
+
+    // the same job gets the same name
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(move ? "move\n" : "copy\n");
+    hash.addData(QFile::encodeName(destDirectory) + '\n');
+    foreach (QString filename, filenames)
+        hash.addData(QFile::encodeName(filename) + '\n');
+    m_path = dir.absoluteFilePath(QString::fromLatin1(hash.result().toHex()) + ".journal");
+
+    read();
+    m_fd = ::open(QFile::encodeName(m_path).constData(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+    return m_fd >= 0;
+}
+
+void CopyJournal::remove()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_fd < 0)
+        return;
+
+    close(m_fd);
+    m_fd = -1;
+    unlink(QFile::encodeName(m_path).constData());
+    m_complete.clear();
+    m_offsets.clear();
+}
+
+bool CopyJournal::isComplete(const QString &src, const struct stat &st)
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, Record>::const_iterator it = m_complete.constFind(src);
+    return it != m_complete.constEnd() && it->size == st.st_size &&
+            it->modified == modifiedNsecs(st);
+}
+
+qint64 CopyJournal::resumeOffset(const QString &src, const struct stat &st)
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, Record>::const_iterator it = m_offsets.constFind(src);
+    if (it == m_offsets.constEnd() || it->size != st.st_size || it->modified != modifiedNsecs(st))
+        return 0;
+    return it->offset;
+}
+
+void CopyJournal::setComplete(const QString &src, const struct stat &st)
+{
+    append('C', src, st, st.st_size, false);
+}
+
+void CopyJournal::setOffset(const QString &src, const struct stat &st, qint64 offset)
+{
+    append('O', src, st, offset, true);
+}
+
+void CopyJournal::read()
+{
+    // called with the mutex locked
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    // lines are: type size modified offset name, a partly written last line is ignored
+    QList<QByteArray> lines = file.readAll().split('\n');
+    lines.removeLast();
+    foreach (const QByteArray &line, lines) {
+        QList<QByteArray> fields = line.split(' ');
+        if (fields.count() != 5 || fields.at(0).length() != 1)
+            continue;
+
+        Record record;
+        record.size = fields.at(1).toLongLong();
+        record.modified = fields.at(2).toLongLong();
+        record.offset = fields.at(3).toLongLong();
+        QString src = QFile::decodeName(QByteArray::fromPercentEncoding(fields.at(4)));
+        if (fields.at(0) == "C") {
+            m_complete.insert(src, record);
+            m_offsets.remove(src);
+        } else if (fields.at(0) == "O") {
+            m_offsets.insert(src, record);
+        }
+    }
+}
+
+void CopyJournal::append(char type, const QString &src, const struct stat &st, qint64 offset,
+                         bool sync)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_fd < 0)
+        return;
+
+    // names are percent encoded, so they have no spaces or newlines
+    QByteArray line;
+    line += type;
+    line += ' ' + QByteArray::number((qint64)st.st_size);
+    line += ' ' + QByteArray::number(modifiedNsecs(st));
+    line += ' ' + QByteArray::number(offset);
+    line += ' ' + QFile::encodeName(src).toPercentEncoding() + '\n';
+
+    // one write per line, so lines of the copy threads are not mixed
+    if (write(m_fd, line.constData(), line.size()) != line.size())
+        return;
+    if (sync)
+        fdatasync(m_fd);
+}
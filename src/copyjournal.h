@@ -0,0 +1,57 @@
+#ifndef COPYJOURNAL_H
+#define COPYJOURNAL_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <sys/stat.h>
+
+/**
+ * @brief CopyJournal records the progress of a copy or move job on disk, so it can be resumed.
+ * The journal is named by the mode, sources and destination of the job, so pasting the same
+ * files to the same directory again finds it. Each line records a completed file or the
+ * offset up to which a file has been written to the disk, with the size and modification time
+ * of the source. A record is used only if the source has not changed since.
+ * The journal is removed when the job completes. Journals of jobs that are not resumed
+ * within a week are removed. The methods can be called from the copy threads.
+ */
+class CopyJournal
+{
+public:
+    CopyJournal();
+    ~CopyJournal();
+
+    // opens the journal of the job and reads the earlier progress, returns false on errors
+    bool open(bool move, const QStringList &filenames, const QString &destDirectory);
+    // removes the journal of a completed job
+    void remove();
+
+    // true if the file was completely copied and has not changed since
+    bool isComplete(const QString &src, const struct stat &st);
+    // bytes of the file known to be on the disk, 0 if none or if the file has changed
+    qint64 resumeOffset(const QString &src, const struct stat &st);
+
+    // completions are not synced, so resuming checks the size of the copy too
+    void setComplete(const QString &src, const struct stat &st);
+    // the copy must have been synced up to the offset
+    void setOffset(const QString &src, const struct stat &st, qint64 offset);
+
+private:
+    struct Record {
+        qint64 size;
+        qint64 modified; // nsecs since epoch
+        qint64 offset;
+    };
+
+    void read();
+    void append(char type, const QString &src, const struct stat &st, qint64 offset, bool sync);
+
+    QMutex m_mutex; // protects the members below
+    QString m_path;
+    int m_fd;
+    QHash<QString, Record> m_complete;
+    QHash<QString, Record> m_offsets;
+};
+
+#endif // COPYJOURNAL_H
@@ -0,0 +1,53 @@
+#include "copyqueue.h"
+#include <QMutexLocker>
+
+CopyQueue::CopyQueue(int capacity) :
+    m_capacity(capacity),
+    m_closed(false),
+    m_aborted(false)
+{
+}
+
+bool CopyQueue::push(const CopyItem &item)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_items.count() >= m_capacity && !m_aborted)
+        m_notFull.wait(&m_mutex);
+
+    if (m_aborted)
+        return false;
+
+    m_items.enqueue(item);
+    m_notEmpty.wakeOne();
+    return true;
+}
+
+bool CopyQueue::pop(CopyItem &item)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_items.isEmpty() && !m_closed && !m_aborted)
+        m_notEmpty.wait(&m_mutex);
+
+    if (m_aborted || m_items.isEmpty())
+        return false;
+
+    item = m_items.dequeue();
+    m_notFull.wakeOne();
+    return true;
+}
+
+void CopyQueue::close()
+{
+    QMutexLocker locker(&m_mutex);
+    m_closed = true;
+    m_notEmpty.wakeAll();
+}
+
+void CopyQueue::abort()
+{
+    QMutexLocker locker(&m_mutex);
+    m_aborted = true;
+    m_items.clear();
+    m_notEmpty.wakeAll();
+    m_notFull.wakeAll();
+}
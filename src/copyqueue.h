@@ -0,0 +1,50 @@
+#ifndef COPYQUEUE_H
+#define COPYQUEUE_H
+
+#include <QString>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+
+// one file to copy, topLevel is the selected file or directory it belongs to (for errors)
+struct CopyItem
+{
+    CopyItem() {}
+    CopyItem(QString src, QString dest, QString topLevel) :
+        src(src), dest(dest), topLevel(topLevel) {}
+
+    QString src;
+    QString dest;
+    QString topLevel;
+};
+
+/**
+ * @brief CopyQueue is a bounded queue between the directory walker and the copy threads.
+ * push() blocks while the queue is full and pop() blocks while it is empty.
+ */
+class CopyQueue
+{
+public:
+    explicit CopyQueue(int capacity);
+
+    // returns false if the queue has been aborted
+    bool push(const CopyItem &item);
+    // returns false when the queue is closed and empty, or aborted
+    bool pop(CopyItem &item);
+
+    // no more items will be pushed, pop() returns the remaining items
+    void close();
+    // drops the remaining items and wakes up everybody waiting
+    void abort();
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<CopyItem> m_items;
+    int m_capacity;
+    bool m_closed;
+    bool m_aborted;
+};
+
+#endif // COPYQUEUE_H
@@ -0,0 +1,93 @@
+#include "crc32c.h"
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+
+// reversed Castagnoli polynomial
+static const quint32 Polynomial = 0x82f63b78;
+
+// tables for processing 8 bytes at a time, table[k][b] is the crc of b followed by k zeros
+struct Crc32cTables
+{
+    Crc32cTables()
+    {
+        for (int i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 1) ? (crc >> 1) ^ Polynomial : crc >> 1;
+            table[0][i] = crc;
+        }
+        for (int i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k)
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+        }
+    }
+
+    quint32 table[8][256];
+};
+
+static const Crc32cTables s_tables;
+
+#endif
+
+quint32 crc32c(quint32 crc, const void *data, size_t length)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+
+#if defined(__SSE4_2__)
+#if defined(__x86_64__)
+    while (length >= 8) {
+        quint64 word;
+        memcpy(&word, p, 8);
+        crc = (quint32)_mm_crc32_u64(crc, word);
+        p += 8;
+        length -= 8;
+    }
+#endif
+    while (length >= 4) {
+        quint32 word;
+        memcpy(&word, p, 4);
+        crc = _mm_crc32_u32(crc, word);
+        p += 4;
+        length -= 4;
+    }
+    while (length--)
+        crc = _mm_crc32_u8(crc, *p++);
+
+#elif defined(__ARM_FEATURE_CRC32)
+    while (length >= 8) {
+        quint64 word;
+        memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+        p += 8;
+        length -= 8;
+    }
+    while (length--)
+        crc = __crc32cb(crc, *p++);
+
+#else
+    const quint32 (*table)[256] = s_tables.table;
+    while (length >= 8) {
+        // bytes are combined explicitly, so this works on any byte order
+        quint32 low = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((quint32)p[3] << 24));
+        quint32 high = p[4] | (p[5] << 8) | (p[6] << 16) | ((quint32)p[7] << 24);
+        crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^
+                table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+                table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^
+                table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length--)
+        crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+#endif
+
+    return ~crc;
+}
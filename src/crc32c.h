@@ -0,0 +1,12 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <QtGlobal>
+#include <stddef.h>
+
+// CRC-32C (Castagnoli) of the data continuing from crc, which is 0 for new data.
+// Uses the crc instructions of SSE 4.2 or ARMv8 when the build targets them,
+// otherwise a table lookup of 8 bytes at a time. Can be called from any thread.
+quint32 crc32c(quint32 crc, const void *data, size_t length);
+
+#endif // CRC32C_H
@@ -0,0 +1,198 @@
+#include "dirsizeservice.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutexLocker>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+// number of cached directory sizes
+static const int MaxCachedSizes = 2000;
+
+static DirSizeService *s_instance = 0;
+
+static qint64 modifiedMsecs(const struct stat &st)
+{
+    // same as FileData::modified, so the model can check the cache without stat
+    return (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+}
+
+DirSizeService *DirSizeService::instance()
+{
+    // the application owns it, so the thread is stopped when the application quits
+    if (!s_instance)
+        s_instance = new DirSizeService(QCoreApplication::instance());
+    return s_instance;
+}
+
+DirSizeService::DirSizeService(QObject *parent) :
+    QThread(parent),
+    m_cache(MaxCachedSizes),
+    m_currentCancelled(false),
+    m_running(false)
+{
+    // queued to the gui thread, where the cache is used
+    connect(this, SIGNAL(sizeCalculated(QString, qint64, qint64)),
+            this, SLOT(storeSize(QString, qint64, qint64)), Qt::QueuedConnection);
+}
+
+DirSizeService::~DirSizeService()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_requests.clear();
+        m_currentCancelled = true;
+    }
+    wait();
+    s_instance = 0;
+}
+
+qint64 DirSizeService::cachedSize(QString path, qint64 modified) const
+{
+    const CachedSize *cached = m_cache.object(path);
+    if (!cached || cached->modified != modified)
+        return -1;
+    return cached->size;
+}
+
+void DirSizeService::requestSize(QString path)
+{
+    bool needStart = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_requestCounts[path];
+        if ((m_current == path && !m_currentCancelled) || m_requests.contains(path))
+            return;
+
+        m_requests.append(path);
+        if (!m_running) {
+            m_running = true;
+            needStart = true;
+        }
+    }
+
+    if (needStart) {
+        wait(); // the thread may still be returning from a previous run
+        start(QThread::LowPriority);
+    }
+}
+
+void DirSizeService::refresh(QString path)
+{
+    m_cache.remove(path);
+    requestSize(path);
+}
+
+void DirSizeService::cancel(QString path)
+{
+    // other models or file infos may still wait for the size
+    QMutexLocker locker(&m_mutex);
+    QHash<QString, int>::iterator it = m_requestCounts.find(path);
+    if (it == m_requestCounts.end())
+        return;
+    if (--it.value() > 0)
+        return;
+
+    m_requestCounts.erase(it);
+    m_requests.removeAll(path);
+    if (m_current == path)
+        m_currentCancelled = true;
+}
+
+bool DirSizeService::isCancelled()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_currentCancelled;
+}
+
+bool DirSizeService::addDirSize(int dirFd, qint64 &size)
+{
+    DIR *dir = fdopendir(dirFd);
+    if (!dir) {
+        close(dirFd);
+        return true; // unreadable directories count as empty
+    }
+
+    bool ok = true;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != 0) {
+        const char *name = ent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            if (isCancelled()) {
+                ok = false;
+                break;
+            }
+            int fd = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+            if (fd >= 0 && !addDirSize(fd, size)) {
+                ok = false;
+                break;
+            }
+            continue;
+        }
+
+        // hard linked files are counted once
+        if (st.st_nlink > 1) {
+            QSet<quint64> &inodes = m_seenInodes[(quint64)st.st_dev];
+            if (inodes.contains((quint64)st.st_ino))
+                continue;
+            inodes.insert((quint64)st.st_ino);
+        }
+        size += st.st_size;
+    }
+    closedir(dir);
+    return ok;
+}
+
+void DirSizeService::run() Q_DECL_OVERRIDE
+{
+    forever {
+        QString path;
+        {
+            QMutexLocker locker(&m_mutex);
+            // the requests of the previous walk are done
+            if (!m_current.isEmpty() && !m_requests.contains(m_current))
+                m_requestCounts.remove(m_current);
+            if (m_requests.isEmpty()) {
+                m_current.clear();
+                m_running = false;
+                return;
+            }
+            path = m_requests.takeFirst();
+            m_current = path;
+            m_currentCancelled = false;
+        }
+
+        int fd = open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+            continue;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            continue;
+        }
+
+        // the fd is closed by the walk
+        qint64 size = 0;
+        if (addDirSize(fd, size))
+            emit sizeCalculated(path, modifiedMsecs(st), size);
+        m_seenInodes.clear();
+    }
+}
+
+void DirSizeService::storeSize(QString path, qint64 modified, qint64 size)
+{
+    CachedSize *cached = new CachedSize;
+    cached->modified = modified;
+    cached->size = size;
+    m_cache.insert(path, cached);
+    emit sizeReady(path, size);
+}
@@ -0,0 +1,75 @@
+#ifndef DIRSIZESERVICE_H
+#define DIRSIZESERVICE_H
+
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QCache>
+#include <QStringList>
+#include <QSet>
+
+/**
+ * @brief DirSizeService calculates the total size of directories in the background.
+ * There is one shared instance, so models and file infos use the same cache. Requests are
+ * handled one at a time in the order they were made. Directories are walked with fstatat()
+ * without following links, and hard linked files are counted once.
+ * Results are cached by path and the modification time of the directory, so a directory
+ * is walked again only when entries have been added or removed directly in it. Changes deeper
+ * in the tree don't change the time, so refresh() can be used to walk it anyway.
+ * The cache is used only in the gui thread and keeps the most recently used sizes.
+ * Requests are counted by path, a walk is cancelled when all of its requesters have cancelled.
+ */
+class DirSizeService : public QThread
+{
+    Q_OBJECT
+
+public:
+    static DirSizeService *instance();
+    ~DirSizeService();
+
+    // returns the size from the cache or -1 if it is not known for this modification time
+    qint64 cachedSize(QString path, qint64 modified) const;
+
+    // starts calculating the size, sizeReady() is emitted when it is known
+    void requestSize(QString path);
+    // drops the cached size and calculates it again
+    void refresh(QString path);
+    // drops one request, the last one removes the queued request or stops the running one
+    void cancel(QString path);
+
+signals:
+    void sizeReady(QString path, qint64 size);
+
+    // emitted in the worker thread, modified is the time seen when the walk started
+    void sizeCalculated(QString path, qint64 modified, qint64 size);
+
+protected:
+    void run();
+
+private slots:
+    void storeSize(QString path, qint64 modified, qint64 size);
+
+private:
+    struct CachedSize {
+        qint64 modified;
+        qint64 size;
+    };
+
+    explicit DirSizeService(QObject *parent = 0);
+    bool isCancelled();
+    bool addDirSize(int dirFd, qint64 &size);
+
+    QCache<QString, CachedSize> m_cache;
+
+    QMutex m_mutex; // protects the request members below
+    QStringList m_requests;
+    QHash<QString, int> m_requestCounts; // requesters of the queued and running paths
+    QString m_current; // path being walked
+    bool m_currentCancelled;
+    bool m_running;
+
+    // walk state, used only in the worker thread
+    QHash<quint64, QSet<quint64> > m_seenInodes; // inodes of hard linked files by device
+};
+
+#endif // DIRSIZESERVICE_H
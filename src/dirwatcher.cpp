@@ -0,0 +1,142 @@
+#include "dirwatcher.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QSocketNotifier>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+
+// events of the entries, writes are reported while a file grows, the refresh timer of the
+// model coalesces them
+static const uint32_t EntryEvents = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+        IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE;
+static const uint32_t SelfEvents = IN_DELETE_SELF | IN_MOVE_SELF;
+
+// read buffer, room for many events with long names
+static const int EventBufferSize = 64 * 1024;
+
+static DirWatcher *s_instance = 0;
+
+DirWatcher *DirWatcher::instance()
+{
+    // the application owns it, so the fd is closed when the application quits
+    if (!s_instance)
+        s_instance = new DirWatcher(QCoreApplication::instance());
+    return s_instance;
+}
+
+DirWatcher::DirWatcher(QObject *parent) :
+    QObject(parent),
+    m_notifier(0)
+{
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd >= 0) {
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, SIGNAL(activated(int)), this, SLOT(readEvents()));
+    }
+}
+
+DirWatcher::~DirWatcher()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+    s_instance = 0;
+}
+
+void DirWatcher::addDir(QString dir)
+{
+    if (dir.isEmpty())
+        return;
+
+    // the watch may have been removed with the directory, then it is added again
+    ++m_refCounts[dir];
+    if (m_watches.contains(dir) || m_fd < 0)
+        return;
+
+    int wd = inotify_add_watch(m_fd, QFile::encodeName(dir).constData(),
+                               EntryEvents | SelfEvents | IN_ONLYDIR);
+    if (wd < 0)
+        return;
+
+    // a directory linked to from several paths has one watch, shared by all of them
+    m_watches.insert(dir, wd);
+    m_paths[wd].append(dir);
+}
+
+void DirWatcher::removeDir(QString dir)
+{
+    QHash<QString, int>::iterator it = m_refCounts.find(dir);
+    if (it == m_refCounts.end())
+        return;
+    if (--it.value() > 0)
+        return;
+
+    m_refCounts.erase(it);
+    if (!m_watches.contains(dir))
+        return;
+
+    // the watch is removed with the last path to the directory
+    int wd = m_watches.take(dir);
+    QHash<int, QStringList>::iterator paths = m_paths.find(wd);
+    if (paths == m_paths.end())
+        return;
+    paths.value().removeOne(dir);
+    if (paths.value().isEmpty()) {
+        m_paths.erase(paths);
+        inotify_rm_watch(m_fd, wd);
+    }
+}
+
+void DirWatcher::readEvents()
+{
+    QByteArray buffer(EventBufferSize, Qt::Uninitialized);
+    forever {
+        ssize_t length = read(m_fd, buffer.data(), buffer.size());
+        if (length < 0 && errno == EINTR)
+            continue;
+        if (length <= 0)
+            return;
+
+        const char *p = buffer.constData();
+        const char *end = p + length;
+        while (p < end) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            // events were lost, everything has to be read again
+            if (event->mask & IN_Q_OVERFLOW) {
+                foreach (QString dir, m_watches.keys())
+                    emit dirChanged(dir);
+                continue;
+            }
+
+            QStringList dirs = m_paths.value(event->wd);
+            if (dirs.isEmpty())
+                continue;
+
+            // the watch is gone with the directory, it is added again if the path is shown again
+            if (event->mask & IN_IGNORED) {
+                m_paths.remove(event->wd);
+                foreach (QString dir, dirs)
+                    m_watches.remove(dir);
+                continue;
+            }
+            if (event->mask & SelfEvents) {
+                foreach (QString dir, dirs)
+                    emit dirChanged(dir);
+                continue;
+            }
+            if (event->len == 0)
+                continue;
+
+            QString name = QFile::decodeName(QByteArray(event->name));
+            Change change = EntryModified;
+            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                change = EntryCreated;
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                change = EntryRemoved;
+            foreach (QString dir, dirs)
+                emit entryChanged(dir, name, change);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef DIRWATCHER_H
+#define DIRWATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+
+class QSocketNotifier;
+
+/**
+ * @brief DirWatcher watches directories with inotify and tells which entries changed.
+ * There is one shared instance with one inotify fd for all models. Directories are reference
+ * counted, so models showing the same directory share its watch. Paths to the same directory,
+ * e.g. through symbolic links, share one watch, which is removed with the last of them, and
+ * each of them gets the events. A rename within a directory
+ * is reported as a removal of the old name and a creation of the new one.
+ * If the kernel drops events or a watched directory itself is moved or deleted, dirChanged()
+ * is emitted instead, and the directory must be read again.
+ */
+class DirWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Change {
+        EntryCreated, EntryRemoved, EntryModified
+    };
+
+    static DirWatcher *instance();
+    ~DirWatcher();
+
+    void addDir(QString dir);
+    void removeDir(QString dir);
+
+signals:
+    // name is the entry in the directory which changed
+    void entryChanged(QString dir, QString name, int change);
+    // changes are not known, emitted also for the directory itself being moved or deleted
+    void dirChanged(QString dir);
+
+private slots:
+    void readEvents();
+
+private:
+    explicit DirWatcher(QObject *parent = 0);
+
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    QHash<QString, int> m_refCounts; // by path
+    QHash<QString, int> m_watches; // watch descriptors by path
+    QHash<int, QStringList> m_paths; // watched paths by watch descriptor
+};
+
+#endif // DIRWATCHER_H
@@ -0,0 +1,430 @@
+#include "dirworker.h"
+#include "metadatacache.h"
+#include "fileindex.h"
+#include "perftrace.h"
+#include <QFile>
+#include <QtAlgorithms>
+#include <QMutexLocker>
+#include <QHash>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// the first batch is small to get something on the screen quickly,
+// following batches grow to keep the number of model inserts low
+static const int FirstBatchSize = 64;
+static const int MaxBatchSize = 1024;
+
+// bytes read to detect the type of files with unknown suffixes
+static const int MagicLength = 16;
+// sniffed types kept, the cache is cleared when it grows over this
+static const int MaxSniffedTypes = 20000;
+
+// sniffed types by device, inode and modification time, shared by all workers
+struct SniffKey
+{
+    quint64 device;
+    quint64 inode;
+    qint64 modified;
+    bool operator==(const SniffKey &other) const {
+        return device == other.device && inode == other.inode && modified == other.modified;
+    }
+};
+
+inline uint qHash(const SniffKey &key)
+{
+    return ::qHash(key.inode) ^ ::qHash(key.device) ^ ::qHash(key.modified);
+}
+
+static QMutex s_sniffMutex;
+static QHash<SniffKey, IconId> s_sniffedTypes;
+
+DirWorker::DirWorker(QObject *parent) :
+    QThread(parent),
+    m_generation(0),
+    m_withStat(true),
+    m_pending(false),
+    m_running(false),
+    m_latestGeneration(0),
+    m_latestStatGeneration(0)
+{
+    m_collator.setCaseSensitivity(Qt::CaseInsensitive);
+    m_collator.setNumericMode(true); // so that img2.jpg comes before img10.jpg
+    qRegisterMetaType<FileDataList>("FileDataList");
+    qRegisterMetaType<QList<int> >("QList<int>");
+}
+
+DirWorker::~DirWorker()
+{
+}
+
+void DirWorker::startReadDir(QString dir, int generation, bool withStat)
+{
+    bool needStart = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_dir = dir;
+        m_generation = generation;
+        m_withStat = withStat;
+        m_pending = true;
+        m_latestGeneration.storeRelease(generation);
+        needStart = claimRunLocked();
+    }
+    startIfNeeded(needStart);
+}
+
+void DirWorker::startStatEntries(QString dir, int generation, QList<int> rows, QStringList names)
+{
+    bool needStart = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_latestStatGeneration.storeRelease(generation);
+
+        // append to the last request if it is for the same directory
+        if (!m_statRequests.isEmpty() && m_statRequests.last().dir == dir &&
+                m_statRequests.last().generation == generation && !m_statRequests.last().update) {
+            m_statRequests.last().rows += rows;
+            m_statRequests.last().names += names;
+        } else {
+            StatRequest request;
+            request.dir = dir;
+            request.generation = generation;
+            request.rows = rows;
+            request.names = names;
+            request.update = false;
+            m_statRequests.append(request);
+        }
+        needStart = claimRunLocked();
+    }
+    startIfNeeded(needStart);
+}
+
+void DirWorker::startUpdateEntries(QString dir, int generation, QStringList names)
+{
+    bool needStart = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        StatRequest request;
+        request.dir = dir;
+        request.generation = generation;
+        request.names = names;
+        request.update = true;
+        m_statRequests.append(request);
+        needStart = claimRunLocked();
+    }
+    startIfNeeded(needStart);
+}
+
+void DirWorker::cancel()
+{
+    // no request has a negative generation, so everything becomes stale
+    m_latestGeneration.storeRelease(-1);
+    m_latestStatGeneration.storeRelease(-1);
+}
+
+bool DirWorker::claimRunLocked()
+{
+    if (m_running)
+        return false;
+
+    m_running = true;
+    return true;
+}
+
+void DirWorker::startIfNeeded(bool needStart)
+{
+    if (needStart) {
+        wait(); // the thread may still be returning from a previous run
+        start();
+    }
+}
+
+void DirWorker::run() Q_DECL_OVERRIDE
+{
+    forever {
+        QString dir;
+        int generation;
+        bool withStat;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_pending) {
+                if (m_statRequests.isEmpty()) {
+                    m_running = false;
+                    return;
+                }
+                StatRequest request = m_statRequests.takeFirst();
+                locker.unlock();
+                if (request.update)
+                    updateEntries(request);
+                else
+                    statEntries(request);
+                continue;
+            }
+            dir = m_dir;
+            generation = m_generation;
+            withStat = m_withStat;
+            m_pending = false;
+        }
+
+        QString errorMessage = readEntries(dir, generation, withStat);
+        if (!isStale(generation))
+            emit done(generation, errorMessage);
+    }
+}
+
+// name as read from the directory, needed to stat the entry relative to the directory fd
+struct DirEntry
+{
+    QByteArray rawName;
+    FileData data;
+    bool needsStat; // kind is not known from d_type
+};
+
+static bool dirEntryLessThan(const DirEntry &e1, const DirEntry &e2)
+{
+    // same order as the default sort order of the model, so entries are mostly appended
+    return e1.data.collationKey->compare(*e2.data.collationKey) < 0;
+}
+
+static DirEntry makeDirEntry(const QByteArray &rawName, unsigned char type, quint64 inode,
+                             const QCollator &collator)
+{
+    DirEntry entry;
+    entry.rawName = rawName;
+    entry.data.name = QFile::decodeName(rawName);
+    entry.data.collationKey = QSharedPointer<QCollatorSortKey>(
+                new QCollatorSortKey(collator.sortKey(entry.data.name)));
+    entry.data.inode = inode;
+
+    // d_type gives the kind without stat, except for links and some file systems
+    entry.needsStat = false;
+    switch (type) {
+    case DT_DIR: entry.data.setKind(S_IFDIR, false); break;
+    case DT_REG: entry.data.setKind(S_IFREG, false); break;
+    case DT_FIFO: entry.data.setKind(S_IFIFO, false); break;
+    case DT_SOCK: entry.data.setKind(S_IFSOCK, false); break;
+    case DT_CHR: entry.data.setKind(S_IFCHR, false); break;
+    case DT_BLK: entry.data.setKind(S_IFBLK, false); break;
+    default: entry.needsStat = true; break;
+    }
+    return entry;
+}
+
+static IconId sniffType(int dirFd, const QByteArray &rawName, const struct stat &st)
+{
+    SniffKey key;
+    key.device = st.st_dev;
+    key.inode = st.st_ino;
+    key.modified = (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+    {
+        QMutexLocker locker(&s_sniffMutex);
+        QHash<SniffKey, IconId>::const_iterator it = s_sniffedTypes.constFind(key);
+        if (it != s_sniffedTypes.constEnd())
+            return it.value();
+    }
+
+    // non-blocking, so a fifo renamed like a file does not hang the worker
+    IconId icon = FileIcon;
+    int fd = openat(dirFd, rawName.constData(), O_RDONLY | O_NONBLOCK | O_NOCTTY);
+    if (fd >= 0) {
+        unsigned char magic[MagicLength];
+        ssize_t n = read(fd, magic, sizeof(magic));
+        close(fd);
+        if (n > 0)
+            icon = magicToIconId(magic, (int)n);
+    }
+
+    QMutexLocker locker(&s_sniffMutex);
+    if (s_sniffedTypes.count() >= MaxSniffedTypes)
+        s_sniffedTypes.clear();
+    s_sniffedTypes.insert(key, icon);
+    return icon;
+}
+
+static void statEntry(int dirFd, DirEntry &entry)
+{
+    PERF_COUNT(StatEntry, 1);
+    struct stat st;
+    if (fstatat(dirFd, entry.rawName.constData(), &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return;
+
+    // links show the information of their target, unless the link is broken
+    bool isLink = S_ISLNK(st.st_mode);
+    if (isLink) {
+        struct stat target;
+        if (fstatat(dirFd, entry.rawName.constData(), &target, 0) == 0)
+            st = target;
+    }
+
+    entry.data.inode = st.st_ino; // of the link like d_ino
+    entry.data.setKind(st.st_mode, isLink);
+    entry.data.setStat(st);
+
+    // files without a known suffix get their type from the first bytes
+    if (!isLink && S_ISREG(st.st_mode) && entry.data.icon == FileIcon)
+        entry.data.icon = sniffType(dirFd, entry.rawName, st);
+}
+
+// closes the directory opened by readEntries()
+static void closeDirectory(DIR *dir, int dirFd)
+{
+    if (dir)
+        closedir(dir);
+    else
+        close(dirFd);
+}
+
+QString DirWorker::readEntries(QString dirname, int generation, bool withStat)
+{
+    PERF_SCOPE(DirRead);
+    QByteArray path = QFile::encodeName(dirname);
+    struct stat st;
+    if (stat(path.constData(), &st) != 0 || !S_ISDIR(st.st_mode))
+        return tr("Directory does not exist");
+
+    if (access(path.constData(), R_OK) == -1)
+        return tr("No permission to read the directory");
+
+    QList<DirEntry> entries;
+    DIR *dir = 0;
+    int dirFd = -1;
+
+    // a cached listing is already sorted and has the stat data the model had
+    FileDataList cached;
+    QList<IndexedEntry> indexed;
+    qint64 dirModified = (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+    if (MetadataCache::instance()->listing(dirname, dirModified, cached)) {
+        dirFd = open(path.constData(), O_RDONLY | O_DIRECTORY);
+        if (dirFd < 0)
+            return tr("No permission to read the directory");
+
+        foreach (const FileData &data, cached) {
+            DirEntry entry;
+            entry.data = data;
+            entry.data.statFromCache = entry.data.hasStat;
+            entry.needsStat = false;
+            entries.append(entry);
+        }
+    } else if (FileIndex::instance()->listing(dirname, dirModified, indexed)) {
+        // the index has the names of the unchanged directory, they are sorted by bytes there
+        dirFd = open(path.constData(), O_RDONLY | O_DIRECTORY);
+        if (dirFd < 0)
+            return tr("No permission to read the directory");
+
+        foreach (const IndexedEntry &indexedEntry, indexed) {
+            entries.append(makeDirEntry(indexedEntry.rawName, indexedEntry.type,
+                                        indexedEntry.inode, m_collator));
+        }
+        qSort(entries.begin(), entries.end(), dirEntryLessThan);
+    } else {
+        dir = opendir(path.constData());
+        if (!dir)
+            return tr("No permission to read the directory");
+
+        // read all names first, readdir is cheap compared to stat
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != 0) {
+            if (isStale(generation)) {
+                closedir(dir);
+                return QString();
+            }
+
+            // hidden files, "." and ".." are not shown
+            if (ent->d_name[0] == '.')
+                continue;
+
+            entries.append(makeDirEntry(QByteArray(ent->d_name), ent->d_type, ent->d_ino,
+                                        m_collator));
+        }
+
+        qSort(entries.begin(), entries.end(), dirEntryLessThan);
+        dirFd = dirfd(dir);
+    }
+
+    // stat in the background while sending the entries in batches
+    FileDataList batch;
+    int batchSize = FirstBatchSize;
+    for (int i = 0; i < entries.count(); ++i) {
+        if (isStale(generation)) {
+            closeDirectory(dir, dirFd);
+            return QString();
+        }
+
+        // cached entries with stats are sent as they are, the model checks them when shown
+        DirEntry &entry = entries[i];
+        if ((withStat && !entry.data.hasStat) || entry.needsStat) {
+            if (entry.rawName.isEmpty())
+                entry.rawName = QFile::encodeName(entry.data.name);
+            statEntry(dirFd, entry);
+        }
+        batch.append(entry.data);
+
+        if (batch.count() >= batchSize) {
+            emit entriesRead(generation, batch);
+            batch.clear();
+            batchSize = qMin(batchSize * 2, MaxBatchSize);
+        }
+    }
+    if (!batch.isEmpty() && !isStale(generation))
+        emit entriesRead(generation, batch);
+
+    closeDirectory(dir, dirFd);
+
+    PERF_SCOPE_VALUE(entries.count());
+    return QString();
+}
+
+void DirWorker::statEntries(const StatRequest &request)
+{
+    if (m_latestStatGeneration.loadAcquire() != request.generation)
+        return;
+
+    int dirFd = open(QFile::encodeName(request.dir).constData(), O_RDONLY | O_DIRECTORY);
+    if (dirFd < 0)
+        return;
+
+    FileDataList entries;
+    for (int i = 0; i < request.names.count(); ++i) {
+        DirEntry entry;
+        entry.data.name = request.names.at(i);
+        entry.rawName = QFile::encodeName(entry.data.name);
+        statEntry(dirFd, entry); // hasStat stays false if the file is gone
+        entries.append(entry.data);
+    }
+    close(dirFd);
+
+    if (m_latestStatGeneration.loadAcquire() == request.generation)
+        emit entriesStatted(request.generation, request.rows, entries);
+}
+
+void DirWorker::updateEntries(const StatRequest &request)
+{
+    // a new read of the directory has the changes anyway
+    if (isStale(request.generation))
+        return;
+
+    FileDataList entries;
+    int dirFd = open(QFile::encodeName(request.dir).constData(), O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0) {
+        foreach (const QString &name, request.names) {
+            // hidden files are not shown, so they are reported as removed
+            if (name.startsWith('.'))
+                continue;
+
+            DirEntry entry = makeDirEntry(QFile::encodeName(name), DT_UNKNOWN, 0, m_collator);
+            statEntry(dirFd, entry);
+            if (entry.data.hasStat)
+                entries.append(entry.data);
+        }
+        close(dirFd);
+    }
+
+    if (!isStale(request.generation))
+        emit entriesUpdated(request.generation, request.names, entries);
+}
+
+bool DirWorker::isStale(int generation) const
+{
+    return m_latestGeneration.loadAcquire() != generation;
+}
@@ -0,0 +1,88 @@
+#ifndef DIRWORKER_H
+#define DIRWORKER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QStringList>
+#include <QCollator>
+#include "filedata.h"
+
+/**
+ * @brief DirWorker reads directory listings in the background.
+ * Entries are sent in batches with the generation number of the request. A new request
+ * makes the currently running read stale, so it stops early and its results are discarded.
+ * Directories are read with readdir() and the kind of most entries comes from d_type,
+ * so stat is needed only for links or if size, permissions and times are requested.
+ * Single entries can be stat-ed later with startStatEntries(), for instance when they
+ * become visible. Directory reads are handled before pending stat requests.
+ * Entries reported changed by the DirWatcher are read with startUpdateEntries(), so only they
+ * are stat-ed instead of reading the whole directory again.
+ * A listing found in the MetadataCache is sent without reading the directory, and names of
+ * an unchanged directory in the FileIndex are used without readdir(). The stats of the cached
+ * entries are only a hint, they are marked with statFromCache for the model to check them.
+ * When a file with an unknown suffix is stat-ed, its type is detected from its first bytes.
+ * The detected types are cached by inode and modification time.
+ */
+class DirWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit DirWorker(QObject *parent = 0);
+    ~DirWorker();
+
+    // starts reading the directory, a possibly running read is abandoned
+    // if withStat is false, then only names and kinds are read
+    void startReadDir(QString dir, int generation, bool withStat = true);
+
+    // stats the named entries of the directory, rows are just passed back with the results
+    void startStatEntries(QString dir, int generation, QList<int> rows, QStringList names);
+
+    // reads the named entries fully, generation is of the last directory read
+    void startUpdateEntries(QString dir, int generation, QStringList names);
+
+    void cancel();
+
+signals: // signals, can be connected from a thread to another
+    void entriesRead(int generation, FileDataList entries);
+    void entriesStatted(int generation, QList<int> rows, FileDataList entries);
+    // entries has the names which exist, the others have been removed
+    void entriesUpdated(int generation, QStringList names, FileDataList entries);
+
+    // emitted when all entries of a request have been sent, error message is empty if ok
+    void done(int generation, QString errorMessage);
+
+protected:
+    void run();
+
+private:
+    struct StatRequest {
+        QString dir;
+        int generation;
+        QList<int> rows;
+        QStringList names;
+        bool update; // from startUpdateEntries()
+    };
+
+    bool claimRunLocked();
+    void startIfNeeded(bool needStart);
+    QString readEntries(QString dir, int generation, bool withStat);
+    void statEntries(const StatRequest &request);
+    void updateEntries(const StatRequest &request);
+    bool isStale(int generation) const;
+
+    QMutex m_mutex; // protects the request members below
+    QString m_dir;
+    int m_generation;
+    bool m_withStat;
+    bool m_pending;
+    bool m_running;
+    QList<StatRequest> m_statRequests;
+    QCollator m_collator; // used only in the worker thread
+
+    // atomic so no locks needed to check for stale requests
+    QAtomicInt m_latestGeneration;
+    QAtomicInt m_latestStatGeneration;
+};
+
+#endif // DIRWORKER_H
@@ -2,36 +2,61 @@
 #include <QDateTime>
 #include "globals.h"
 #include "fileworker.h"
+#include "fileindex.h"
+#include "perftrace.h"
+#include <QSettings>
+#include <sys/stat.h>
+
+// device of the file or its closest existing parent, 0 if not known
+static quint64 deviceOf(QString filename)
+{
+    QString path = QDir::cleanPath(filename);
+    forever {
+        struct stat st;
+        if (stat(QFile::encodeName(path).constData(), &st) == 0)
+            return st.st_dev;
+
+        QString parent = QFileInfo(path).absolutePath();
+        if (parent == path)
+            return 0;
+        path = parent;
+    }
+}
 
 Engine::Engine(QObject *parent) :
     QObject(parent),
     m_clipboardCut(true),
-    m_progress(0)
+    m_progress(0),
+    m_bytesDone(0),
+    m_bytesTotal(0),
+    m_bytesPerSecond(0),
+    m_secondsLeft(-1),
+    m_copyThreadCount(0),
+    m_verifyCopies(false),
+    m_skipUnchanged(false),
+    m_nextJobId(1),
+    m_currentJobId(0)
 {
-    m_fileWorker = new FileWorker;
-
-    // update progress property when worker progresses
-    connect(m_fileWorker, SIGNAL(progressChanged(int, QString)),
-            this, SLOT(setProgress(int, QString)));
+    // also creates the index in the gui thread before the workers use it
+    QSettings settings("harbour-file-browser", "harbour-file-browser");
+    FileIndex::instance()->setEnabled(settings.value("index/enabled", false).toBool());
 
-    // pass worker end signals to QML
-    connect(m_fileWorker, SIGNAL(done()), this, SIGNAL(workerDone()));
-    connect(m_fileWorker, SIGNAL(errorOccurred(QString, QString)),
-            this, SIGNAL(workerErrorOccurred(QString, QString)));
+    connect(PerfTrace::instance(), SIGNAL(statsChanged()), this, SIGNAL(perfStatsChanged()));
 }
 
 Engine::~Engine()
 {
     // is this the way to force stop the worker thread?
-    m_fileWorker->cancel(); // stop possibly running background thread
-    m_fileWorker->wait();   // wait until thread stops
-    delete m_fileWorker;    // delete it
+    foreach (FileWorker *worker, m_workers) {
+        worker->cancel(); // stop possibly running background thread
+        worker->wait();   // wait until thread stops
+        delete worker;    // delete it
+    }
 }
 
-void Engine::deleteFiles(QStringList filenames)
+int Engine::deleteFiles(QStringList filenames)
 {
-    setProgress(0, "");
-    m_fileWorker->startDeleteFiles(filenames);
+    return addJob(DeleteJob, filenames, QString());
 }
 
 void Engine::cutFiles(QStringList filenames)
@@ -50,20 +75,19 @@ void Engine::copyFiles(QStringList filenames)
     emit clipboardCutChanged();
 }
 
-void Engine::pasteFiles(QString destDirectory)
+int Engine::pasteFiles(QString destDirectory)
 {
     if (m_clipboardFiles.isEmpty()) {
-        emit workerErrorOccurred("No files to paste", "");
-        return;
+        emit workerErrorOccurred("No files to paste", "", false);
+        return 0;
     }
 
     QStringList files = m_clipboardFiles;
-    setProgress(0, "");
 
     QDir dest(destDirectory);
     if (!dest.exists()) {
-        emit workerErrorOccurred(tr("Destination does not exist"), destDirectory);
-        return;
+        emit workerErrorOccurred(tr("Destination does not exist"), destDirectory, false);
+        return 0;
     }
 
     foreach (QString filename, files) {
@@ -72,31 +96,48 @@ void Engine::pasteFiles(QString destDirectory)
 
         // source and dest filenames are the same?
         if (filename == newname) {
-            emit workerErrorOccurred(tr("Can't overwrite itself"), newname);
-            return;
+            emit workerErrorOccurred(tr("Can't overwrite itself"), newname, false);
+            return 0;
         }
 
         // dest is under source? (directory)
         if (newname.startsWith(filename)) {
-            emit workerErrorOccurred(tr("Can't move/copy to itself"), filename);
-            return;
+            emit workerErrorOccurred(tr("Can't move/copy to itself"), filename, false);
+            return 0;
         }
     }
 
     m_clipboardFiles.clear();
     emit clipboardCountChanged();
 
-    if (m_clipboardCut) {
-        m_fileWorker->startMoveFiles(files, destDirectory);
-        return;
-    }
-
-    m_fileWorker->startCopyFiles(files, destDirectory);
+    return addJob(m_clipboardCut ? MoveJob : CopyJob, files, destDirectory);
 }
 
 void Engine::cancel()
 {
-    m_fileWorker->cancel();
+    foreach (const Job &job, m_queuedJobs)
+        emit jobErrorOccurred(job.id, tr("Cancelled"), "");
+    m_queuedJobs.clear();
+    emit jobCountChanged();
+
+    foreach (FileWorker *worker, m_runningJobs.keys())
+        worker->cancel();
+}
+
+void Engine::cancelJob(int jobId)
+{
+    for (int i = 0; i < m_queuedJobs.count(); ++i) {
+        if (m_queuedJobs.at(i).id == jobId) {
+            m_queuedJobs.removeAt(i);
+            emit jobErrorOccurred(jobId, tr("Cancelled"), "");
+            emit jobCountChanged();
+            return;
+        }
+    }
+
+    FileWorker *worker = m_runningJobs.key(jobId, 0);
+    if (worker)
+        worker->cancel();
 }
 
 bool Engine::exists(QString filename)
@@ -104,11 +145,231 @@ bool Engine::exists(QString filename)
     return QFile::exists(filename);
 }
 
+void Engine::setCopyThreadCount(int count)
+{
+    if (m_copyThreadCount == count)
+        return;
+
+    m_copyThreadCount = count;
+    foreach (FileWorker *worker, m_workers)
+        worker->setCopyThreadCount(count);
+    emit copyThreadCountChanged();
+}
+
+void Engine::setVerifyCopies(bool verify)
+{
+    if (m_verifyCopies == verify)
+        return;
+
+    m_verifyCopies = verify;
+    foreach (FileWorker *worker, m_workers)
+        worker->setVerifyCopies(verify);
+    emit verifyCopiesChanged();
+}
+
+void Engine::setSkipUnchanged(bool skip)
+{
+    if (m_skipUnchanged == skip)
+        return;
+
+    m_skipUnchanged = skip;
+    foreach (FileWorker *worker, m_workers)
+        worker->setSkipUnchanged(skip);
+    emit skipUnchangedChanged();
+}
+
+bool Engine::indexEnabled() const
+{
+    return FileIndex::instance()->isEnabled();
+}
+
+void Engine::setIndexEnabled(bool enabled)
+{
+    if (FileIndex::instance()->isEnabled() == enabled)
+        return;
+
+    FileIndex::instance()->setEnabled(enabled);
+    QSettings settings("harbour-file-browser", "harbour-file-browser");
+    settings.setValue("index/enabled", enabled);
+    emit indexEnabledChanged();
+}
+
+bool Engine::perfTracing() const
+{
+    return PerfTrace::isEnabled();
+}
+
+void Engine::setPerfTracing(bool enabled)
+{
+    // statsChanged is emitted also when tracing is switched
+    PerfTrace::instance()->setEnabled(enabled);
+}
+
+QVariantMap Engine::perfStats() const
+{
+    return PerfTrace::instance()->stats();
+}
+
 void Engine::setProgress(int progress, QString filename)
 {
+    // progress properties show only the current job
+    if (sender()) {
+        int jobId = jobIdOf(sender());
+        emit jobProgressChanged(jobId, progress, filename);
+        if (jobId != m_currentJobId)
+            return;
+    }
+
     m_progress = progress;
     m_progressFilename = filename;
     emit progressChanged();
     emit progressFilenameChanged();
 }
 
+void Engine::resetProgress()
+{
+    // not through the slots, their sender() would be a worker when called from its signal
+    m_progress = 0;
+    m_progressFilename.clear();
+    m_bytesDone = 0;
+    m_bytesTotal = 0;
+    m_bytesPerSecond = 0;
+    m_secondsLeft = -1;
+    emit progressChanged();
+    emit progressFilenameChanged();
+    emit bytesDoneChanged();
+    emit bytesTotalChanged();
+    emit bytesPerSecondChanged();
+    emit secondsLeftChanged();
+}
+
+void Engine::setTransferProgress(qint64 bytesDone, qint64 bytesTotal, qint64 bytesPerSecond)
+{
+    if (sender() && jobIdOf(sender()) != m_currentJobId)
+        return;
+
+    m_bytesDone = bytesDone;
+    m_bytesTotal = bytesTotal;
+    m_bytesPerSecond = bytesPerSecond;
+    m_secondsLeft = -1;
+    if (bytesPerSecond > 0 && bytesTotal >= bytesDone)
+        m_secondsLeft = (int)((bytesTotal - bytesDone) / bytesPerSecond);
+
+    emit bytesDoneChanged();
+    emit bytesTotalChanged();
+    emit bytesPerSecondChanged();
+    emit secondsLeftChanged();
+}
+
+void Engine::handleWorkerDone()
+{
+    emit jobDone(jobIdOf(sender()));
+
+    // the finishing job is still counted as running
+    if (jobCount() <= 1)
+        emit workerDone();
+}
+
+void Engine::handleWorkerError(QString message, QString filename, bool storageFull)
+{
+    emit jobErrorOccurred(jobIdOf(sender()), message, filename);
+    emit workerErrorOccurred(message, filename, storageFull);
+}
+
+void Engine::handleWorkerFinished()
+{
+    // the worker thread has really stopped, so it can start the next job of its device
+    FileWorker *worker = static_cast<FileWorker *>(sender());
+    int jobId = m_runningJobs.take(worker);
+    emit jobCountChanged();
+
+    // the progress properties switch to a job still running on another device
+    if (jobId == m_currentJobId && !m_runningJobs.isEmpty()) {
+        m_currentJobId = m_runningJobs.constBegin().value();
+        resetProgress();
+    }
+    startJobs();
+}
+
+int Engine::addJob(JobType type, QStringList filenames, QString destDirectory)
+{
+    Job job;
+    job.id = m_nextJobId++;
+    job.type = type;
+    job.filenames = filenames;
+    job.destDirectory = destDirectory;
+    job.device = deviceOf(type == DeleteJob ? filenames.value(0) : destDirectory);
+    m_queuedJobs.append(job);
+    emit jobCountChanged();
+
+    startJobs();
+    return job.id;
+}
+
+void Engine::startJobs()
+{
+    // start the first queued job of every idle device
+    for (int i = 0; i < m_queuedJobs.count(); ) {
+        FileWorker *worker = workerForDevice(m_queuedJobs.at(i).device);
+        if (m_runningJobs.contains(worker)) {
+            ++i;
+            continue;
+        }
+
+        Job job = m_queuedJobs.takeAt(i);
+        m_runningJobs.insert(worker, job.id);
+        m_currentJobId = job.id;
+        resetProgress();
+
+        bool started = false;
+        switch (job.type) {
+        case DeleteJob:
+            started = worker->startDeleteFiles(job.filenames);
+            break;
+        case CopyJob:
+            started = worker->startCopyFiles(job.filenames, job.destDirectory);
+            break;
+        case MoveJob:
+            started = worker->startMoveFiles(job.filenames, job.destDirectory);
+            break;
+        }
+
+        // the error has been reported, the thread won't finish, so the job is dropped here
+        if (!started) {
+            m_runningJobs.remove(worker);
+            emit jobCountChanged();
+        }
+    }
+}
+
+FileWorker *Engine::workerForDevice(quint64 device)
+{
+    FileWorker *worker = m_workers.value(device, 0);
+    if (worker)
+        return worker;
+
+    worker = new FileWorker;
+    worker->setCopyThreadCount(m_copyThreadCount);
+    worker->setVerifyCopies(m_verifyCopies);
+    worker->setSkipUnchanged(m_skipUnchanged);
+
+    // update progress property when worker progresses
+    connect(worker, SIGNAL(progressChanged(int, QString)),
+            this, SLOT(setProgress(int, QString)));
+    connect(worker, SIGNAL(transferProgressChanged(qint64, qint64, qint64)),
+            this, SLOT(setTransferProgress(qint64, qint64, qint64)));
+
+    // pass worker end signals to QML
+    connect(worker, SIGNAL(done()), this, SLOT(handleWorkerDone()));
+    connect(worker, SIGNAL(errorOccurred(QString, QString, bool)),
+            this, SLOT(handleWorkerError(QString, QString, bool)));
+    connect(worker, SIGNAL(finished()), this, SLOT(handleWorkerFinished()));
+
+    m_workers.insert(device, worker);
+    return worker;
+}
+
+int Engine::jobIdOf(QObject *worker) const
+{
+    return m_runningJobs.value(static_cast<FileWorker *>(worker), 0);
+}
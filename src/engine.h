@@ -2,11 +2,17 @@
 #define ENGINE_H
 
 #include <QDir>
+#include <QHash>
+#include <QList>
+#include <QVariantMap>
 
 class FileWorker;
 
 /**
  * @brief Engine to handle cut, copy and paste.
+ * File operations are queued as jobs with ids. Jobs on the same device run one after
+ * another, jobs on different devices (like internal storage and memory card) run in parallel,
+ * each device has its own worker thread. The progress properties follow the latest started job.
  */
 class Engine : public QObject
 {
@@ -15,6 +21,17 @@ class Engine : public QObject
     Q_PROPERTY(int clipboardCut READ clipboardCut() NOTIFY clipboardCutChanged())
     Q_PROPERTY(int progress READ progress() NOTIFY progressChanged())
     Q_PROPERTY(QString progressFilename READ progressFilename() NOTIFY progressFilenameChanged())
+    Q_PROPERTY(qint64 bytesDone READ bytesDone() NOTIFY bytesDoneChanged())
+    Q_PROPERTY(qint64 bytesTotal READ bytesTotal() NOTIFY bytesTotalChanged())
+    Q_PROPERTY(qint64 bytesPerSecond READ bytesPerSecond() NOTIFY bytesPerSecondChanged())
+    Q_PROPERTY(int secondsLeft READ secondsLeft() NOTIFY secondsLeftChanged())
+    Q_PROPERTY(int copyThreadCount READ copyThreadCount() WRITE setCopyThreadCount(int) NOTIFY copyThreadCountChanged())
+    Q_PROPERTY(bool verifyCopies READ verifyCopies() WRITE setVerifyCopies(bool) NOTIFY verifyCopiesChanged())
+    Q_PROPERTY(bool skipUnchanged READ skipUnchanged() WRITE setSkipUnchanged(bool) NOTIFY skipUnchangedChanged())
+    Q_PROPERTY(int jobCount READ jobCount() NOTIFY jobCountChanged())
+    Q_PROPERTY(bool indexEnabled READ indexEnabled() WRITE setIndexEnabled(bool) NOTIFY indexEnabledChanged())
+    Q_PROPERTY(bool perfTracing READ perfTracing() WRITE setPerfTracing(bool) NOTIFY perfStatsChanged())
+    Q_PROPERTY(QVariantMap perfStats READ perfStats() NOTIFY perfStatsChanged())
 
 public:
     explicit Engine(QObject *parent = 0);
@@ -24,16 +41,35 @@ public:
     bool clipboardCut() const { return m_clipboardCut; }
     int progress() const { return m_progress; }
     QString progressFilename() const { return m_progressFilename; }
+    qint64 bytesDone() const { return m_bytesDone; }
+    qint64 bytesTotal() const { return m_bytesTotal; }
+    qint64 bytesPerSecond() const { return m_bytesPerSecond; }
+    int secondsLeft() const { return m_secondsLeft; } // -1 if not known
+    int copyThreadCount() const { return m_copyThreadCount; } // 0 selects by destination
+    void setCopyThreadCount(int count);
+    bool verifyCopies() const { return m_verifyCopies; }
+    void setVerifyCopies(bool verify);
+    bool skipUnchanged() const { return m_skipUnchanged; } // paste copies only new and changed files
+    void setSkipUnchanged(bool skip);
+    int jobCount() const { return m_queuedJobs.count() + m_runningJobs.count(); }
+    bool indexEnabled() const;
+    void setIndexEnabled(bool enabled); // saved in the settings
+    bool perfTracing() const; // tracing costs a little, so it is on only for the debug page
+    void setPerfTracing(bool enabled);
+    QVariantMap perfStats() const; // updated every second while tracing, see PerfTrace
 
     // methods accessible from QML
 
-    // asynch methods send signals when done or error occurs
-    Q_INVOKABLE void deleteFiles(QStringList filenames);
+    // asynch methods send signals when done or error occurs, they return the job id
+    // or 0 if the job was not started
+    Q_INVOKABLE int deleteFiles(QStringList filenames);
     Q_INVOKABLE void cutFiles(QStringList filenames);
     Q_INVOKABLE void copyFiles(QStringList filenames);
-    Q_INVOKABLE void pasteFiles(QString destDirectory);
+    Q_INVOKABLE int pasteFiles(QString destDirectory);
 
+    // cancels all jobs
     Q_INVOKABLE void cancel();
+    Q_INVOKABLE void cancelJob(int jobId);
 
     Q_INVOKABLE QString errorMessage() const { return m_errorMessage; }
 
@@ -44,20 +80,71 @@ signals:
     void clipboardCutChanged();
     void progressChanged();
     void progressFilenameChanged();
+    void bytesDoneChanged();
+    void bytesTotalChanged();
+    void bytesPerSecondChanged();
+    void secondsLeftChanged();
+    void copyThreadCountChanged();
+    void verifyCopiesChanged();
+    void skipUnchangedChanged();
+    void jobCountChanged();
+    void indexEnabledChanged();
+    void perfStatsChanged();
+
+    // emitted for every job
+    void jobProgressChanged(int jobId, int progress, QString filename);
+    void jobDone(int jobId);
+    void jobErrorOccurred(int jobId, QString message, QString filename);
+
+    // workerDone is emitted when all jobs are done, errors are emitted for every job
     void workerDone();
-    void workerErrorOccurred(QString message, QString filename);
+    // storageFull is true if the destination ran out of space
+    void workerErrorOccurred(QString message, QString filename, bool storageFull);
     void workerCancelDone();
 
 private slots:
     void setProgress(int progress, QString filename);
+    void setTransferProgress(qint64 bytesDone, qint64 bytesTotal, qint64 bytesPerSecond);
+    void handleWorkerDone();
+    void handleWorkerError(QString message, QString filename, bool storageFull);
+    void handleWorkerFinished();
 
 private:
+    enum JobType {
+        DeleteJob, CopyJob, MoveJob
+    };
+    struct Job {
+        int id;
+        JobType type;
+        QStringList filenames;
+        QString destDirectory;
+        quint64 device; // jobs on the same device are run one after another
+    };
+
+    int addJob(JobType type, QStringList filenames, QString destDirectory);
+    void startJobs();
+    void resetProgress();
+    FileWorker *workerForDevice(quint64 device);
+    int jobIdOf(QObject *worker) const;
+
     QStringList m_clipboardFiles;
     bool m_clipboardCut;
     int m_progress;
     QString m_progressFilename;
+    qint64 m_bytesDone;
+    qint64 m_bytesTotal;
+    qint64 m_bytesPerSecond;
+    int m_secondsLeft;
+    int m_copyThreadCount;
+    bool m_verifyCopies;
+    bool m_skipUnchanged;
     QString m_errorMessage;
-    FileWorker *m_fileWorker;
+
+    int m_nextJobId;
+    int m_currentJobId; // the job shown in the progress properties
+    QList<Job> m_queuedJobs;
+    QHash<FileWorker *, int> m_runningJobs; // worker to job id
+    QHash<quint64, FileWorker *> m_workers; // one worker per device
 };
 
 #endif // ENGINE_H
@@ -0,0 +1,68 @@
+#include "filedata.h"
+#include <QDateTime>
+
+FileData::FileData() :
+    kind('?'),
+    icon(FileIcon),
+    hasStat(false),
+    statFromCache(false),
+    size(0),
+    modified(0),
+    permissions(0),
+    inode(0)
+{
+}
+
+void FileData::setKind(mode_t mode, bool isLink)
+{
+    // links to directories are shown as directories, so they can be opened
+    if (S_ISDIR(mode)) {
+        kind = 'd';
+        icon = FolderIcon;
+    } else if (isLink) {
+        kind = 'l';
+        icon = LinkIcon;
+    } else if (S_ISREG(mode)) {
+        kind = '-';
+        icon = fileNameToIconId(name);
+    } else {
+        kind = '?';
+        icon = FileIcon;
+    }
+}
+
+static QFile::Permissions modeToPermissions(mode_t mode)
+{
+    // owner bits are used for both owner and user permissions, so they show like in ls
+    QFile::Permissions p = 0;
+    if (mode & S_IRUSR) p |= QFile::ReadOwner | QFile::ReadUser;
+    if (mode & S_IWUSR) p |= QFile::WriteOwner | QFile::WriteUser;
+    if (mode & S_IXUSR) p |= QFile::ExeOwner | QFile::ExeUser;
+    if (mode & S_IRGRP) p |= QFile::ReadGroup;
+    if (mode & S_IWGRP) p |= QFile::WriteGroup;
+    if (mode & S_IXGRP) p |= QFile::ExeGroup;
+    if (mode & S_IROTH) p |= QFile::ReadOther;
+    if (mode & S_IWOTH) p |= QFile::WriteOther;
+    if (mode & S_IXOTH) p |= QFile::ExeOther;
+    return p;
+}
+
+bool FileData::matchesStat(const struct stat &st) const
+{
+    return size == st.st_size && permissions == modeToPermissions(st.st_mode) &&
+            modified == (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+}
+
+void FileData::setStat(const struct stat &st)
+{
+    size = st.st_size;
+    permissions = modeToPermissions(st.st_mode);
+    modified = (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+    qint64 created = (qint64)st.st_ctim.tv_sec * 1000 + st.st_ctim.tv_nsec / 1000000;
+
+    permissionsText = permissionsToString(permissions);
+    sizeText = S_ISDIR(st.st_mode) ? QString() : filesizeToString(size);
+    modifiedText = datetimeToString(QDateTime::fromMSecsSinceEpoch(modified));
+    createdText = datetimeToString(QDateTime::fromMSecsSinceEpoch(created));
+    hasStat = true;
+}
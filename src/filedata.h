@@ -0,0 +1,49 @@
+#ifndef FILEDATA_H
+#define FILEDATA_H
+
+#include <QString>
+#include <QFile>
+#include <QList>
+#include <QMetaType>
+#include <QSharedPointer>
+#include <QCollator>
+#include <sys/stat.h>
+#include "globals.h"
+
+// struct to hold data for a single file
+// the texts shown in views are formatted once when the directory is read,
+// so model data access does not stat, allocate or use locales
+struct FileData
+{
+    FileData();
+
+    // sets kind and icon, mode is of the link target if the file is a symbolic link
+    void setKind(mode_t mode, bool isLink);
+    // sets the size, permission and time fields and formats their texts
+    void setStat(const struct stat &st);
+    // true if size, permissions and modification time are the same as in the stat
+    bool matchesStat(const struct stat &st) const;
+
+    QString name;
+    QSharedPointer<QCollatorSortKey> collationKey; // for sorting by name, set when read
+    char kind; // 'd', 'l', '-' or '?' like in ls
+    IconId icon;
+    bool hasStat; // false if only the name and kind are known
+    bool statFromCache; // the stat data is from the MetadataCache, it is checked when shown
+    QString permissionsText;
+    QString sizeText; // empty for directories
+    QString modifiedText;
+    QString createdText;
+
+    // raw values used to detect modified files
+    qint64 size;
+    qint64 modified; // msecs since epoch
+    QFile::Permissions permissions;
+    quint64 inode;
+};
+
+typedef QList<FileData> FileDataList;
+
+Q_DECLARE_METATYPE(FileDataList)
+
+#endif // FILEDATA_H
@@ -0,0 +1,637 @@
+#include "fileindex.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QThread>
+#include <QVector>
+#include <QtAlgorithms>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+// the index is built again when it is older than this (milliseconds)
+static const qint64 MaxIndexAge = 24 * 60 * 60 * 1000LL;
+// delay from the last change to building the index again (milliseconds)
+static const int RebuildDelay = 60 * 1000;
+// delay from enabling to building a missing index, so it does not slow down the startup
+static const int InitialBuildDelay = 5 * 1000;
+// bigger trees are not indexed
+static const int MaxIndexEntries = 1000000;
+
+static const quint32 NoParent = 0xffffffff;
+static const char IndexMagic[4] = { 'F', 'B', 'I', 'X' };
+static const quint32 IndexVersion = 1;
+
+// file layout: header, entries, names
+struct IndexHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 entryCount;
+    quint32 rootCount; // the first entries are the roots, their names are absolute paths
+    quint32 namesSize;
+    quint32 reserved;
+    qint64 created; // msecs since epoch
+};
+
+struct IndexFileEntry
+{
+    quint32 parent;
+    quint32 firstChild; // children are sorted by name
+    quint32 childCount;
+    quint32 nameOffset;
+    quint64 inode;
+    qint64 modified; // msecs since epoch, for directories only, -1 if not read
+    quint16 nameLength;
+    quint8 type; // d_type
+    quint8 reserved[5];
+};
+
+static FileIndex *s_instance = 0;
+
+static QString indexPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+            "/harbour-file-browser/index.bin";
+}
+
+static QStringList indexRoots()
+{
+    QStringList roots;
+    roots << QDir::homePath() << "/run/user/100000/media/sdcard" << "/media/sdcard";
+
+    // the memory card may be linked to more than one place, index it once
+    QStringList existing;
+    QStringList canonical;
+    foreach (QString root, roots) {
+        QFileInfo info(root);
+        if (!info.isDir() || canonical.contains(info.canonicalFilePath()))
+            continue;
+        existing << QDir::cleanPath(root);
+        canonical << info.canonicalFilePath();
+    }
+    return existing;
+}
+
+static qint64 modifiedMsecs(const struct stat &st)
+{
+    return (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+}
+
+// the order of names in the index, bytes and then length
+static int compareNames(const char *name1, int length1, const char *name2, int length2)
+{
+    int cmp = memcmp(name1, name2, qMin(length1, length2));
+    if (cmp != 0)
+        return cmp;
+    return length1 - length2;
+}
+
+/**
+ * @brief IndexData is one memory mapped index file, it is not changed after loading.
+ */
+class IndexData
+{
+public:
+    IndexData() : m_header(0), m_entries(0), m_names(0) {}
+
+    bool open(QString path)
+    {
+        m_file.setFileName(path);
+        if (!m_file.open(QIODevice::ReadOnly))
+            return false;
+
+        qint64 size = m_file.size();
+        if (size < (qint64)sizeof(IndexHeader))
+            return false;
+        const uchar *map = m_file.map(0, size);
+        if (!map)
+            return false;
+
+        const IndexHeader *header = (const IndexHeader *)map;
+        if (memcmp(header->magic, IndexMagic, 4) != 0 || header->version != IndexVersion ||
+                header->rootCount > header->entryCount)
+            return false;
+        qint64 expected = sizeof(IndexHeader) +
+                (qint64)header->entryCount * sizeof(IndexFileEntry) + header->namesSize;
+        if (size < expected)
+            return false;
+
+        m_header = header;
+        m_entries = (const IndexFileEntry *)(map + sizeof(IndexHeader));
+        m_names = (const char *)(m_entries + header->entryCount);
+        return true;
+    }
+
+    qint64 created() const { return m_header->created; }
+    quint32 count() const { return m_header->entryCount; }
+    const IndexFileEntry &entry(quint32 id) const { return m_entries[id]; }
+    const char *name(quint32 id) const { return m_names + m_entries[id].nameOffset; }
+
+    // returns the id of the directory, or NoParent if it is not indexed
+    quint32 findDirectory(QString dir) const
+    {
+        dir = QDir::cleanPath(dir);
+        for (quint32 root = 0; root < m_header->rootCount; ++root) {
+            QString rootPath = QFile::decodeName(QByteArray(name(root), entry(root).nameLength));
+            if (dir == rootPath)
+                return root;
+            if (!dir.startsWith(rootPath + "/"))
+                continue;
+
+            quint32 id = root;
+            QStringList parts = dir.mid(rootPath.length() + 1).split('/');
+            foreach (QString part, parts) {
+                id = findChild(id, QFile::encodeName(part));
+                if (id == NoParent)
+                    return NoParent;
+            }
+            return entry(id).type == DT_DIR ? id : NoParent;
+        }
+        return NoParent;
+    }
+
+    // absolute path of the entry
+    QString path(quint32 id) const
+    {
+        QList<QByteArray> parts;
+        while (id != NoParent) {
+            parts.prepend(QByteArray::fromRawData(name(id), entry(id).nameLength));
+            id = entry(id).parent;
+        }
+        QByteArray joined;
+        foreach (const QByteArray &part, parts) {
+            if (!joined.isEmpty())
+                joined += '/';
+            joined += part;
+        }
+        return QFile::decodeName(joined);
+    }
+
+private:
+    quint32 findChild(quint32 id, const QByteArray &childName) const
+    {
+        const IndexFileEntry &dir = entry(id);
+        int low = dir.firstChild;
+        int high = (int)(dir.firstChild + dir.childCount) - 1;
+        while (low <= high) {
+            int mid = (low + high) / 2;
+            int cmp = compareNames(childName.constData(), childName.length(),
+                                   name(mid), entry(mid).nameLength);
+            if (cmp == 0)
+                return mid;
+            if (cmp < 0)
+                high = mid - 1;
+            else
+                low = mid + 1;
+        }
+        return NoParent;
+    }
+
+    QFile m_file;
+    const IndexHeader *m_header;
+    const IndexFileEntry *m_entries;
+    const char *m_names;
+};
+
+/**
+ * @brief IndexBuilder crawls the roots and writes a new index file.
+ */
+class IndexBuilder : public QThread
+{
+public:
+    IndexBuilder(QStringList roots, QString path) :
+        m_roots(roots), m_path(path), m_cancelled(0), m_ok(false) {}
+
+    // the builder is reused, so a cancel of an earlier build is forgotten here
+    void startBuild()
+    {
+        m_cancelled.storeRelease(0);
+        start(QThread::IdlePriority);
+    }
+    void cancel() { m_cancelled.storeRelease(1); }
+    bool ok() const { return m_ok; }
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        m_ok = crawl() && write();
+        m_entries.clear();
+    }
+
+private:
+    struct BuildEntry {
+        quint32 parent;
+        QByteArray name;
+        unsigned char type;
+        quint64 inode;
+        qint64 modified;
+        quint64 device;
+        quint32 firstChild;
+        quint32 childCount;
+    };
+
+    static bool nameLessThan(const BuildEntry &e1, const BuildEntry &e2)
+    {
+        return compareNames(e1.name.constData(), e1.name.length(),
+                            e2.name.constData(), e2.name.length()) < 0;
+    }
+
+    QByteArray buildPath(quint32 id) const
+    {
+        QByteArray path = m_entries.at(id).name;
+        for (id = m_entries.at(id).parent; id != NoParent; id = m_entries.at(id).parent)
+            path = m_entries.at(id).name + '/' + path;
+        return path;
+    }
+
+    bool crawl()
+    {
+        foreach (QString root, m_roots) {
+            struct stat st;
+            QByteArray path = QFile::encodeName(root);
+            if (stat(path.constData(), &st) != 0)
+                continue;
+            BuildEntry entry;
+            entry.parent = NoParent;
+            entry.name = path;
+            entry.type = DT_DIR;
+            entry.inode = st.st_ino;
+            entry.modified = modifiedMsecs(st);
+            entry.device = st.st_dev;
+            entry.firstChild = 0;
+            entry.childCount = 0;
+            m_entries.append(entry);
+        }
+        m_rootCount = m_entries.count();
+
+        // breadth first, so the children of a directory are added together
+        for (int i = 0; i < m_entries.count(); ++i) {
+            if (m_cancelled.loadAcquire())
+                return false;
+            if (m_entries.at(i).type != DT_DIR || m_entries.at(i).modified < 0)
+                continue;
+
+            QList<BuildEntry> children;
+            if (!readChildren(i, children)) {
+                m_entries[i].modified = -1; // unreadable, never used for listings
+                continue;
+            }
+            if (m_entries.count() + children.count() > MaxIndexEntries)
+                return false;
+
+            qSort(children.begin(), children.end(), nameLessThan);
+            m_entries[i].firstChild = m_entries.count();
+            m_entries[i].childCount = children.count();
+            foreach (const BuildEntry &child, children)
+                m_entries.append(child);
+        }
+        return true;
+    }
+
+    bool readChildren(quint32 id, QList<BuildEntry> &children)
+    {
+        DIR *dir = opendir(buildPath(id).constData());
+        if (!dir)
+            return false;
+
+        quint64 device = m_entries.at(id).device;
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != 0) {
+            // hidden files are not shown or searched
+            if (ent->d_name[0] == '.')
+                continue;
+
+            BuildEntry entry;
+            entry.parent = id;
+            entry.name = QByteArray(ent->d_name);
+            entry.type = ent->d_type;
+            entry.inode = ent->d_ino;
+            entry.modified = 0;
+            entry.device = device;
+            entry.firstChild = 0;
+            entry.childCount = 0;
+
+            if (entry.type == DT_DIR || entry.type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                    continue;
+                entry.type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK :
+                             S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+                if (entry.type == DT_DIR) {
+                    // other file systems mounted below are not indexed
+                    entry.modified = (quint64)st.st_dev == device ? modifiedMsecs(st) : -1;
+                    entry.device = st.st_dev;
+                }
+            }
+            children.append(entry);
+        }
+        closedir(dir);
+        return true;
+    }
+
+    bool write()
+    {
+        QByteArray names;
+        QByteArray table(m_entries.count() * sizeof(IndexFileEntry), 0);
+        IndexFileEntry *fileEntries = (IndexFileEntry *)table.data();
+        for (int i = 0; i < m_entries.count(); ++i) {
+            const BuildEntry &entry = m_entries.at(i);
+            IndexFileEntry &fileEntry = fileEntries[i];
+            fileEntry.parent = entry.parent;
+            fileEntry.firstChild = entry.firstChild;
+            fileEntry.childCount = entry.childCount;
+            fileEntry.nameOffset = names.length();
+            fileEntry.inode = entry.inode;
+            fileEntry.modified = entry.modified;
+            fileEntry.nameLength = (quint16)qMin(entry.name.length(), 0xffff);
+            fileEntry.type = entry.type;
+            names += entry.name;
+        }
+
+        IndexHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, IndexMagic, 4);
+        header.version = IndexVersion;
+        header.entryCount = m_entries.count();
+        header.rootCount = m_rootCount;
+        header.namesSize = names.length();
+        header.created = QDateTime::currentMSecsSinceEpoch();
+
+        // written to a temporary file first, so a mapped index is never changed
+        QDir().mkpath(QFileInfo(m_path).absolutePath());
+        QString tmp = m_path + ".tmp";
+        QFile file(tmp);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+        bool ok = file.write((const char *)&header, sizeof(header)) == sizeof(header) &&
+                file.write(table) == table.length() && file.write(names) == names.length();
+        file.close();
+        if (!ok || m_cancelled.loadAcquire() ||
+                rename(QFile::encodeName(tmp).constData(), QFile::encodeName(m_path).constData()) != 0) {
+            QFile::remove(tmp);
+            return false;
+        }
+        return true;
+    }
+
+    QStringList m_roots;
+    QString m_path;
+    QAtomicInt m_cancelled;
+    bool m_ok;
+    QVector<BuildEntry> m_entries;
+    int m_rootCount;
+};
+
+FileIndex *FileIndex::instance()
+{
+    // created in the gui thread by the engine before any worker uses it
+    if (!s_instance)
+        s_instance = new FileIndex(QCoreApplication::instance());
+    return s_instance;
+}
+
+FileIndex::FileIndex(QObject *parent) :
+    QObject(parent),
+    m_enabled(false),
+    m_builder(0)
+{
+    m_buildTimer = new QTimer(this);
+    m_buildTimer->setSingleShot(true);
+    connect(m_buildTimer, SIGNAL(timeout()), this, SLOT(startBuild()));
+}
+
+FileIndex::~FileIndex()
+{
+    if (m_builder) {
+        m_builder->cancel();
+        m_builder->wait();
+        delete m_builder;
+    }
+    s_instance = 0;
+}
+
+void FileIndex::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled)
+        return;
+
+    m_enabled = enabled;
+    if (enabled) {
+        load();
+        QSharedPointer<IndexData> index = data();
+        if (!index || QDateTime::currentMSecsSinceEpoch() - index->created() > MaxIndexAge)
+            m_buildTimer->start(InitialBuildDelay);
+        return;
+    }
+
+    m_buildTimer->stop();
+    if (m_builder) {
+        m_builder->cancel();
+        m_builder->wait();
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_data.clear();
+        m_staleDirs.clear();
+        m_staleWhileBuilding.clear();
+    }
+    QFile::remove(indexPath());
+}
+
+bool FileIndex::listing(QString dir, qint64 dirModified, QList<IndexedEntry> &entries)
+{
+    QSharedPointer<IndexData> index = data();
+    if (!index)
+        return false;
+
+    quint32 id = index->findDirectory(dir);
+    if (id == NoParent || index->entry(id).modified != dirModified)
+        return false;
+
+    const IndexFileEntry &dirEntry = index->entry(id);
+    for (quint32 i = dirEntry.firstChild; i < dirEntry.firstChild + dirEntry.childCount; ++i) {
+        IndexedEntry entry;
+        entry.rawName = QByteArray(index->name(i), index->entry(i).nameLength);
+        entry.type = index->entry(i).type;
+        entry.inode = index->entry(i).inode;
+        entries.append(entry);
+    }
+    return true;
+}
+
+// case insensitive search of ascii text in a name, other bytes must match exactly
+static bool containsAscii(const char *name, int length, const QByteArray &lowerText)
+{
+    int textLength = lowerText.length();
+    for (int i = 0; i + textLength <= length; ++i) {
+        int j = 0;
+        while (j < textLength) {
+            char c = name[i + j];
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            if (c != lowerText.at(j))
+                break;
+            ++j;
+        }
+        if (j == textLength)
+            return true;
+    }
+    return false;
+}
+
+bool FileIndex::search(QString dir, QString text, SearchResultHandler *handler)
+{
+    QSharedPointer<IndexData> index = data();
+    if (!index || text.isEmpty())
+        return false;
+
+    dir = QDir::cleanPath(dir);
+    quint32 dirId = index->findDirectory(dir);
+    if (dirId == NoParent || isStale(dir))
+        return false;
+
+    // the directories under dir in breadth first order, a changed one means that entries were
+    // added or removed there, so the index can't answer and nothing is sent
+    QVector<quint32> dirIds;
+    QStringList dirPaths;
+    dirIds.append(dirId);
+    dirPaths.append(dir);
+    for (int d = 0; d < dirIds.count(); ++d) {
+        const IndexFileEntry &dirEntry = index->entry(dirIds.at(d));
+        if (dirEntry.modified < 0)
+            continue; // was not readable, the walk skips it too
+        struct stat st;
+        if (stat(QFile::encodeName(dirPaths.at(d)).constData(), &st) != 0 ||
+                modifiedMsecs(st) != dirEntry.modified)
+            return false;
+
+        for (quint32 i = dirEntry.firstChild; i < dirEntry.firstChild + dirEntry.childCount; ++i) {
+            if (index->entry(i).type != DT_DIR)
+                continue;
+            dirIds.append(i);
+            dirPaths.append(dirPaths.at(d) + '/' +
+                            QFile::decodeName(QByteArray(index->name(i), index->entry(i).nameLength)));
+        }
+    }
+
+    // ascii texts are matched without decoding the names
+    QByteArray lowerText = text.toLower().toUtf8();
+    bool ascii = true;
+    for (int i = 0; i < lowerText.length() && ascii; ++i)
+        ascii = (unsigned char)lowerText.at(i) < 128;
+
+    for (int d = 0; d < dirIds.count(); ++d) {
+        const IndexFileEntry &dirEntry = index->entry(dirIds.at(d));
+        for (quint32 i = dirEntry.firstChild; i < dirEntry.firstChild + dirEntry.childCount; ++i) {
+            const IndexFileEntry &entry = index->entry(i);
+            QString name;
+            if (ascii) {
+                if (!containsAscii(index->name(i), entry.nameLength, lowerText))
+                    continue;
+                name = QFile::decodeName(QByteArray(index->name(i), entry.nameLength));
+            } else {
+                name = QFile::decodeName(QByteArray(index->name(i), entry.nameLength));
+                if (!name.contains(text, Qt::CaseInsensitive))
+                    continue;
+            }
+
+            SearchResult result;
+            result.dir = dirPaths.at(d);
+            result.data.name = name;
+            result.data.setKind(entry.type == DT_DIR ? S_IFDIR : S_IFREG, entry.type == DT_LNK);
+            if (!handler->addResult(result))
+                return true;
+        }
+    }
+    return true;
+}
+
+void FileIndex::markStale(QString dir)
+{
+    if (!m_enabled)
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_data)
+            return;
+        dir = QDir::cleanPath(dir);
+        m_staleDirs.insert(dir);
+        if (m_builder && m_builder->isRunning())
+            m_staleWhileBuilding.insert(dir);
+    }
+    m_buildTimer->start(RebuildDelay);
+}
+
+void FileIndex::startBuild()
+{
+    if (!m_enabled)
+        return;
+
+    // changes during the build are handled by the next one
+    if (m_builder && m_builder->isRunning())
+        return;
+
+    if (!m_builder) {
+        m_builder = new IndexBuilder(indexRoots(), indexPath());
+        connect(m_builder, SIGNAL(finished()), this, SLOT(buildFinished()));
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_staleWhileBuilding.clear();
+    }
+    m_builder->startBuild();
+}
+
+void FileIndex::buildFinished()
+{
+    if (!m_enabled || !m_builder->ok())
+        return;
+
+    load();
+    bool rebuild;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_staleDirs = m_staleWhileBuilding;
+        m_staleWhileBuilding.clear();
+        rebuild = !m_staleDirs.isEmpty();
+    }
+    if (rebuild)
+        m_buildTimer->start(RebuildDelay);
+    emit indexBuilt();
+}
+
+QSharedPointer<IndexData> FileIndex::data()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_data;
+}
+
+void FileIndex::load()
+{
+    QSharedPointer<IndexData> index(new IndexData);
+    if (!index->open(indexPath()))
+        index.clear();
+
+    // readers keep using the old mapping until they are done with it
+    QMutexLocker locker(&m_mutex);
+    m_data = index;
+}
+
+bool FileIndex::isStale(const QString &dir)
+{
+    QMutexLocker locker(&m_mutex);
+    foreach (const QString &stale, m_staleDirs) {
+        if (stale == dir || stale.startsWith(dir + "/"))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,81 @@
+#ifndef FILEINDEX_H
+#define FILEINDEX_H
+
+#include <QObject>
+#include <QMutex>
+#include <QSet>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QTimer>
+#include "searchworker.h"
+
+class IndexBuilder;
+class IndexData;
+
+// one directory entry as read with readdir()
+struct IndexedEntry
+{
+    QByteArray rawName;
+    unsigned char type; // d_type
+    quint64 inode;
+};
+
+/**
+ * @brief FileIndex is an optional on-disk index of the names under home and the memory card.
+ * The index file is memory mapped and has a header, a table of entries and the names. The
+ * entries are in breadth first order, so the children of a directory are next to each other
+ * and sorted by name, and every entry has the id of its parent. A directory is found by
+ * binary searching its path one name at a time, and paths are built by following the parents.
+ * Directories keep their modification time, so a listing is only used if the directory has
+ * not changed. Directories reported changed by the watchers are marked stale and searches
+ * touching them go to the disk, until the index is built again by a low priority crawler
+ * some time after the last change. A search also checks the modification times of the
+ * directories under the searched one, so added, removed or renamed entries send it to the
+ * disk even if no watcher saw them. Listings and searches can be used from any thread.
+ */
+class FileIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static FileIndex *instance();
+    ~FileIndex();
+
+    bool isEnabled() const { return m_enabled; }
+    // disabling removes the index file
+    void setEnabled(bool enabled);
+
+    // gets the entries of the directory, returns false if it is not indexed with this time
+    bool listing(QString dir, qint64 dirModified, QList<IndexedEntry> &entries);
+
+    // searches names like SearchWorker does, the results are given to the handler one at a time
+    // returns false if the index can't answer, then the handler has not been called
+    bool search(QString dir, QString text, SearchResultHandler *handler);
+
+    // called when a directory has changed, the index is built again later
+    void markStale(QString dir);
+
+signals:
+    void indexBuilt();
+
+private slots:
+    void startBuild();
+    void buildFinished();
+
+private:
+    explicit FileIndex(QObject *parent = 0);
+    QSharedPointer<IndexData> data();
+    void load();
+    bool isStale(const QString &dir);
+
+    bool m_enabled;
+    QTimer *m_buildTimer;
+    IndexBuilder *m_builder;
+
+    QMutex m_mutex; // protects the members below
+    QSharedPointer<IndexData> m_data;
+    QSet<QString> m_staleDirs;
+    QSet<QString> m_staleWhileBuilding; // changes seen while the crawler was running
+};
+
+#endif // FILEINDEX_H
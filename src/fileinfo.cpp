@@ -1,17 +1,41 @@
 #include "fileinfo.h"
 #include <QDir>
 #include <QDateTime>
-#include <QProcess>
 #include "globals.h"
+#include "dirsizeservice.h"
+#include "metadatacache.h"
+#include "commandrunner.h"
+#include "checksumworker.h"
+#include "perftrace.h"
+#include <sys/stat.h>
 
 FileInfo::FileInfo(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_checksumProgress(-1),
+    m_checksumGeneration(0),
+    m_checksumWorker(0),
+    m_commandId(0)
 {
     m_file = "";
+    m_processOutput = new ConsoleModel(this);
+    connect(DirSizeService::instance(), SIGNAL(sizeReady(QString, qint64)),
+            this, SLOT(updateDirSize(QString, qint64)));
+    connect(CommandRunner::instance(), SIGNAL(outputReady(int, QString)),
+            this, SLOT(appendCommandOutput(int, QString)));
+    connect(CommandRunner::instance(), SIGNAL(finished(int, int)),
+            this, SLOT(handleCommandFinish(int, int)));
 }
 
 FileInfo::~FileInfo()
 {
+    if (m_dirSize.isEmpty() && m_data.kind == 'd')
+        DirSizeService::instance()->cancel(m_fileInfo.absoluteFilePath());
+
+    if (m_checksumWorker) {
+        m_checksumWorker->cancel(); // stop possibly running calculation
+        m_checksumWorker->wait();
+        delete m_checksumWorker;
+    }
 }
 
 void FileInfo::setFile(QString file)
@@ -26,42 +50,32 @@ void FileInfo::setFile(QString file)
 
 QString FileInfo::kind() const
 {
-    if (m_fileInfo.isDir()) return "d";
-    if (m_fileInfo.isSymLink()) return "l";
-    if (m_fileInfo.isFile()) return "-";
-    return "?";
+    return fileKindToString(m_data.kind);
 }
 
 QString FileInfo::icon() const
 {
-    if (m_fileInfo.isDir()) return "folder";
-    if (m_fileInfo.isSymLink()) return "link";
-    if (m_fileInfo.isFile()) {
-        QString suffix = m_fileInfo.suffix().toLower();
-        return suffixToIconName(suffix);
-    }
-    return "file";
+    return iconIdToName(m_data.icon);
 }
 
 QString FileInfo::permissions() const
 {
-    return permissionsToString(m_fileInfo.permissions());
+    return m_data.permissionsText;
 }
 
 QString FileInfo::size() const
 {
-    if (m_fileInfo.isDir()) return "";
-    return filesizeToString(m_fileInfo.size());
+    return m_data.sizeText;
 }
 
 QString FileInfo::modified() const
 {
-    return datetimeToString(m_fileInfo.lastModified());
+    return m_data.modifiedText;
 }
 
 QString FileInfo::created() const
 {
-    return datetimeToString(m_fileInfo.created());
+    return m_data.createdText;
 }
 
 QString FileInfo::absolutePath() const
@@ -89,54 +103,118 @@ QString FileInfo::errorMessage() const
     return m_errorMessage;
 }
 
-QString FileInfo::processOutput() const
+void FileInfo::executeCommand(QString command, QStringList arguments)
 {
-    return m_processOutput;
+    // the command keeps running if this is destroyed, only its output is not shown
+    m_processOutput->clear();
+    m_commandId = CommandRunner::instance()->start(command, arguments);
 }
 
-void FileInfo::executeCommand(QString command, QStringList arguments)
+void FileInfo::appendCommandOutput(int commandId, QString text)
 {
-    m_processOutput.clear();
-    emit processOutputChanged();
+    if (commandId == m_commandId)
+        m_processOutput->appendText(text);
+}
+
+void FileInfo::handleCommandFinish(int commandId, int exitCode)
+{
+    if (commandId != m_commandId)
+        return;
 
-    // process is killed when Page is closed - should run this in bg thread to allow command finish(?)
-    m_process = new QProcess(this);
-    m_process->setReadChannel(QProcess::StandardOutput);
-    m_process->setProcessChannelMode(QProcess::MergedChannels); // merged stderr channel with stdout channel
-    connect(m_process, SIGNAL(readyReadStandardOutput()), this, SLOT(readProcessChannels()));
-    connect(m_process, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(handleProcessFinish(int, QProcess::ExitStatus)));
-    connect(m_process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(handleProcessError(QProcess::ProcessError)));
-    m_process->start(command, arguments);
+    m_commandId = 0;
+    emit processExited(exitCode);
 }
 
-void FileInfo::readProcessChannels()
+bool FileInfo::statFile(QString path, FileData &data)
 {
-    while (m_process->canReadLine()) {
-        QString line = m_process->readLine();
-        m_processOutput += line;
+    // links show the information of their target, unless the link is broken
+    QByteArray encoded = QFile::encodeName(path);
+    struct stat st;
+    if (lstat(encoded.constData(), &st) != 0)
+        return false;
+
+    bool isLink = S_ISLNK(st.st_mode);
+    if (isLink) {
+        struct stat target;
+        if (stat(encoded.constData(), &target) == 0)
+            st = target;
     }
-    emit processOutputChanged();
+
+    data.name = QFileInfo(path).fileName();
+    data.setKind(st.st_mode, isLink);
+    data.setStat(st);
+    return true;
 }
 
-void FileInfo::handleProcessFinish(int exitCode, QProcess::ExitStatus status)
+void FileInfo::updateDirSize(QString path, qint64 size)
 {
-    if (status == QProcess::CrashExit) // if it crashed, then use some error exit code
-        exitCode = -99999;
-    emit processExited(exitCode);
+    if (m_data.kind != 'd' || path != m_fileInfo.absoluteFilePath())
+        return;
+
+    m_dirSize = filesizeToString(size);
+    emit dirSizeChanged();
 }
 
-void FileInfo::handleProcessError(QProcess::ProcessError error)
+void FileInfo::computeChecksum()
 {
-    Q_UNUSED(error);
-    emit processExited(-88888); // if error, then use some error exit code
+    if (m_data.kind != '-' || m_checksumProgress >= 0)
+        return;
+
+    if (!m_checksumWorker) {
+        m_checksumWorker = new ChecksumWorker;
+        connect(m_checksumWorker, SIGNAL(progressChanged(int, int)),
+                this, SLOT(setChecksumProgress(int, int)));
+        connect(m_checksumWorker, SIGNAL(done(int, QString, QString)),
+                this, SLOT(checksumDone(int, QString, QString)));
+    }
+
+    m_checksumWorker->startChecksum(m_fileInfo.absoluteFilePath(), ++m_checksumGeneration);
+    m_checksumProgress = 0;
+    emit checksumProgressChanged();
+}
+
+void FileInfo::setChecksumProgress(int generation, int progress)
+{
+    if (generation != m_checksumGeneration || m_checksumProgress < 0)
+        return;
+
+    m_checksumProgress = progress;
+    emit checksumProgressChanged();
+}
+
+void FileInfo::checksumDone(int generation, QString checksum, QString errorMessage)
+{
+    if (generation != m_checksumGeneration)
+        return;
+
+    m_checksum = errorMessage.isEmpty() ? checksum : errorMessage;
+    m_checksumProgress = -1;
+    emit checksumChanged();
+    emit checksumProgressChanged();
+}
+
+void FileInfo::cancelChecksum()
+{
+    if (m_checksumWorker)
+        m_checksumWorker->cancel();
+    ++m_checksumGeneration;
+    m_checksum.clear();
+    m_checksumProgress = -1;
+    emit checksumChanged();
+    emit checksumProgressChanged();
 }
 
 void FileInfo::readFile()
 {
+    PERF_SCOPE(FileInfoRead);
     m_errorMessage = "";
+    cancelChecksum();
 
+    // the listing of the directory page usually has the file already
     m_fileInfo = QFileInfo(m_file);
-    if (!m_fileInfo.exists())
+    m_data = FileData();
+    if (!MetadataCache::instance()->fileData(m_fileInfo.absoluteFilePath(), m_data) &&
+            !statFile(m_fileInfo.absoluteFilePath(), m_data))
         m_errorMessage = tr("File does not exist");
 
     emit fileChanged();
@@ -144,6 +222,18 @@ void FileInfo::readFile()
     emit iconChanged();
     emit permissionsChanged();
     emit sizeChanged();
+
+    m_dirSize = "";
+    if (m_data.kind == 'd') {
+        QString path = m_fileInfo.absoluteFilePath();
+        qint64 size = DirSizeService::instance()->cachedSize(path, m_data.modified);
+        if (size >= 0)
+            m_dirSize = filesizeToString(size);
+        else
+            DirSizeService::instance()->requestSize(path);
+    }
+    emit dirSizeChanged();
+
     emit modifiedChanged();
     emit createdChanged();
     emit absolutePathChanged();
@@ -3,11 +3,21 @@
 
 #include <QObject>
 #include <QDir>
-#include <QProcess>
 #include <QVariantList>
+#include "filedata.h"
+#include "consolemodel.h"
+
+class ChecksumWorker;
 
 /**
  * @brief The FileInfo class provides access to information of one file.
+ * Kind, size, permissions and times come from the MetadataCache if the directory listing
+ * is cached, otherwise the file is stat-ed.
+ * The total size of a directory is calculated in the background, dirSize is empty until then.
+ * Commands of executeCommand() are run by the CommandRunner, so they are not killed when
+ * this is destroyed. Their output is appended to the processOutput model, which keeps the
+ * last lines up to its maxSize.
+ * computeChecksum() calculates the CRC-32C of the file in a background thread.
  */
 class FileInfo : public QObject
 {
@@ -17,6 +27,7 @@ class FileInfo : public QObject
     Q_PROPERTY(QString icon READ icon() NOTIFY iconChanged())
     Q_PROPERTY(QString permissions READ permissions() NOTIFY permissionsChanged())
     Q_PROPERTY(QString size READ size() NOTIFY sizeChanged())
+    Q_PROPERTY(QString dirSize READ dirSize() NOTIFY dirSizeChanged())
     Q_PROPERTY(QString modified READ modified() NOTIFY modifiedChanged())
     Q_PROPERTY(QString created READ created() NOTIFY createdChanged())
     Q_PROPERTY(QString absolutePath READ absolutePath() NOTIFY absolutePathChanged())
@@ -24,7 +35,9 @@ class FileInfo : public QObject
     Q_PROPERTY(QString suffix READ suffix() NOTIFY suffixChanged())
     Q_PROPERTY(QString symLinkTarget READ symLinkTarget() NOTIFY symLinkTargetChanged())
     Q_PROPERTY(QString errorMessage READ errorMessage() NOTIFY errorMessageChanged())
-    Q_PROPERTY(QString processOutput READ processOutput() NOTIFY processOutputChanged())
+    Q_PROPERTY(QString checksum READ checksum() NOTIFY checksumChanged())
+    Q_PROPERTY(int checksumProgress READ checksumProgress() NOTIFY checksumProgressChanged())
+    Q_PROPERTY(ConsoleModel *processOutput READ processOutput() CONSTANT)
 
 public:
     explicit FileInfo(QObject *parent = 0);
@@ -38,6 +51,7 @@ public:
     QString icon() const;
     QString permissions() const;
     QString size() const;
+    QString dirSize() const { return m_dirSize; } // empty until calculated
     QString modified() const;
     QString created() const;
     QString absolutePath() const;
@@ -45,9 +59,12 @@ public:
     QString suffix() const;
     QString symLinkTarget() const;
     QString errorMessage() const;
-    QString processOutput() const;
+    QString checksum() const { return m_checksum; } // empty until calculated
+    int checksumProgress() const { return m_checksumProgress; } // -1 if not calculating
+    ConsoleModel *processOutput() const { return m_processOutput; }
 
     // methods accessible from QML
+    Q_INVOKABLE void computeChecksum();
     Q_INVOKABLE void executeCommand(QString command, QStringList arguments);
 
 signals:
@@ -56,6 +73,7 @@ signals:
     void iconChanged();
     void permissionsChanged();
     void sizeChanged();
+    void dirSizeChanged();
     void modifiedChanged();
     void createdChanged();
     void nameChanged();
@@ -63,23 +81,34 @@ signals:
     void absolutePathChanged();
     void symLinkTargetChanged();
     void errorMessageChanged();
+    void checksumChanged();
+    void checksumProgressChanged();
 
-    void processOutputChanged();
     void processExited(int exitCode);
 
 private slots:
-    void readProcessChannels();
-    void handleProcessFinish(int exitCode, QProcess::ExitStatus status);
-    void handleProcessError(QProcess::ProcessError error);
+    void appendCommandOutput(int commandId, QString text);
+    void handleCommandFinish(int commandId, int exitCode);
+    void updateDirSize(QString path, qint64 size);
+    void setChecksumProgress(int generation, int progress);
+    void checksumDone(int generation, QString checksum, QString errorMessage);
 
 private:
     void readFile();
+    void cancelChecksum();
+    static bool statFile(QString path, FileData &data);
 
     QString m_file;
-    QFileInfo m_fileInfo;
+    QFileInfo m_fileInfo; // for the path parts, not stat-ed
+    FileData m_data;
     QString m_errorMessage;
-    QProcess *m_process;
-    QString m_processOutput;
+    QString m_dirSize;
+    QString m_checksum;
+    int m_checksumProgress;
+    int m_checksumGeneration; // incremented for each request, used to discard stale results
+    ChecksumWorker *m_checksumWorker; // created when needed
+    int m_commandId; // id of the running command or 0
+    ConsoleModel *m_processOutput;
 };
 
 #endif // FILEINFO_H
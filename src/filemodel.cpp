@@ -1,7 +1,18 @@
 #include "filemodel.h"
 #include <QDateTime>
+#include <QHash>
+#include <QtAlgorithms>
+#include <QUrl>
 #include "globals.h"
+#include "dirworker.h"
+#include "dirsizeservice.h"
+#include "metadatacache.h"
+#include "fileindex.h"
+#include "dirwatcher.h"
+#include "thumbnailservice.h"
+#include "perftrace.h"
 #include <QDebug>
+#include <sys/stat.h>
 
 enum {
     FilenameRole = Qt::UserRole + 1,
@@ -10,71 +21,177 @@ enum {
     PermissionsRole = Qt::UserRole + 4,
     SizeRole = Qt::UserRole + 5,
     LastModifiedRole = Qt::UserRole + 6,
-    CreatedRole = Qt::UserRole + 7
+    CreatedRole = Qt::UserRole + 7,
+    DirSizeRole = Qt::UserRole + 8,
+    ThumbnailRole = Qt::UserRole + 9
 };
 
+// default coalescing window for change notifications (milliseconds)
+static const int DefaultRefreshDelay = 300;
+static const int DefaultMaxRefreshDelay = 2000;
+
+// entries kept with their texts in inactive models, older inactive models are compacted
+static const int InactiveEntryBudget = 10000;
+// more changed entries than this are read by reading the whole directory
+static const int MaxPendingChanges = 200;
+// new entries going to more places than this are inserted with one layout change
+static const int MaxInsertGroups = 32;
+
+// inactive models, the most recently deactivated last
+static QList<FileModel *> s_inactiveModels;
+
+// compares file indexes with the current sort order of the model
+class FileIndexLessThan
+{
+public:
+    FileIndexLessThan(const FileModel *model) : m_model(model) {}
+    bool operator()(int fileIndex1, int fileIndex2) const {
+        return m_model->lessThan(fileIndex1, fileIndex2);
+    }
+
+private:
+    const FileModel *m_model;
+};
+
+// files with the named entries replaced by the given entries, names not in them are removed
+static FileDataList replaceEntries(const FileDataList &files, const QStringList &names,
+                                   const FileDataList &entries)
+{
+    QSet<QString> replaced = names.toSet();
+    FileDataList result;
+    foreach (const FileData &data, files) {
+        if (!replaced.contains(data.name))
+            result.append(data);
+    }
+    result += entries;
+    return result;
+}
+
+// suffix without allocating a new string, empty if the name has no dot
+static QStringRef suffixRef(const QString &name)
+{
+    int i = name.lastIndexOf('.');
+    if (i < 0)
+        return QStringRef();
+    return name.midRef(i+1);
+}
+
 FileModel::FileModel(QObject *parent) :
     QAbstractListModel(parent),
+    m_refreshing(false),
     m_active(false),
-    m_dirty(false)
+    m_dirty(false),
+    m_loading(false),
+    m_generation(0),
+    m_sortBy(SortByName),
+    m_compacted(false),
+    m_snapshotModified(0),
+    m_fullRefreshPending(false),
+    m_pendingUpdates(0),
+    m_statGeneration(0),
+    m_refreshDelay(DefaultRefreshDelay),
+    m_maxRefreshDelay(DefaultMaxRefreshDelay)
 {
     m_dir = "";
-    m_watcher = new QFileSystemWatcher(this);
-    connect(m_watcher, SIGNAL(directoryChanged(const QString&)), this, SLOT(refresh()));
-    connect(m_watcher, SIGNAL(fileChanged(const QString&)), this, SLOT(refresh()));
+    connect(DirWatcher::instance(), SIGNAL(entryChanged(QString, QString, int)),
+            this, SLOT(entryChanged(QString, QString, int)));
+    connect(DirWatcher::instance(), SIGNAL(dirChanged(QString)), this, SLOT(dirChanged(QString)));
+
+    // stat requests from data() calls of the same event loop round are sent together
+    m_statTimer = new QTimer(this);
+    m_statTimer->setSingleShot(true);
+    m_statTimer->setInterval(0);
+    connect(m_statTimer, SIGNAL(timeout()), this, SLOT(flushStatRequests()));
+
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setSingleShot(true);
+    connect(m_refreshTimer, SIGNAL(timeout()), this, SLOT(refreshChanges()));
+
+    m_dirWorker = new DirWorker;
+    connect(m_dirWorker, SIGNAL(entriesRead(int, FileDataList)),
+            this, SLOT(appendEntries(int, FileDataList)));
+    connect(m_dirWorker, SIGNAL(done(int, QString)), this, SLOT(readDone(int, QString)));
+    connect(m_dirWorker, SIGNAL(entriesStatted(int, QList<int>, FileDataList)),
+            this, SLOT(applyStats(int, QList<int>, FileDataList)));
+    connect(m_dirWorker, SIGNAL(entriesUpdated(int, QStringList, FileDataList)),
+            this, SLOT(applyEntryUpdates(int, QStringList, FileDataList)));
+
+    connect(DirSizeService::instance(), SIGNAL(sizeReady(QString, qint64)),
+            this, SLOT(updateDirSize(QString, qint64)));
+    connect(ThumbnailService::instance(), SIGNAL(thumbnailReady(QString)),
+            this, SLOT(updateThumbnail(QString)));
 }
 
 FileModel::~FileModel()
 {
+    if (!m_compacted)
+        storeListing(); // keeps the stat data for the next page showing this directory
+    s_inactiveModels.removeAll(this);
+    DirWatcher::instance()->removeDir(m_dir);
+    cancelDirSizes();
+    m_dirWorker->cancel(); // stop possibly running background read
+    m_dirWorker->wait();
+    delete m_dirWorker;
 }
 
 int FileModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    return m_files.count();
+    return m_rows.count();
 }
 
 QVariant FileModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid() || index.row() > m_files.size()-1)
+    PERF_SCOPE(ModelData);
+    if (!index.isValid() || index.row() > m_rows.size()-1)
         return QVariant();
 
-    QFileInfo info = m_files.at(index.row()).info;
+    int fileIndex = m_rows.at(index.row());
+    const FileData &data = m_files.at(fileIndex);
+    switch (role) {
+    case PermissionsRole:
+    case SizeRole:
+    case LastModifiedRole:
+    case CreatedRole:
+    case DirSizeRole:
+    case ThumbnailRole:
+        // texts are empty until the file has been stat-ed, cached ones are checked when shown
+        if (!data.hasStat || data.statFromCache)
+            requestStat(fileIndex);
+        break;
+    default:
+        break;
+    }
+
     switch (role) {
 
     case Qt::DisplayRole:
     case FilenameRole:
-        return info.fileName();
+        return data.name;
 
     case FileKindRole:
-        if (info.isDir()) return "d";
-        if (info.isSymLink()) return "l";
-        if (info.isFile()) return "-";
-        return "?";
+        return fileKindToString(data.kind);
 
     case FileIconRole:
-        if (info.isDir()) return "folder";
-        if (info.isSymLink()) return "link";
-        if (info.isFile()) {
-            QString suffix = info.suffix().toLower();
-            return suffixToIconName(suffix);
-        }
-        return "file";
+        return iconIdToName(data.icon);
 
     case PermissionsRole:
-        return permissionsToString(info.permissions());
+        return data.permissionsText;
 
     case SizeRole:
-        if (info.isDir()) return "";
-        return filesizeToString(info.size());
+        return data.sizeText;
 
-    case LastModifiedRole: {
-        return datetimeToString(info.lastModified());
-    }
+    case LastModifiedRole:
+        return data.modifiedText;
 
-    case CreatedRole: {
-        return datetimeToString(info.created());
-    }
+    case CreatedRole:
+        return data.createdText;
+
+    case DirSizeRole:
+        return dirSizeText(data);
+
+    case ThumbnailRole:
+        return thumbnailSource(data);
 
     default:
         return QVariant();
@@ -91,12 +208,14 @@ QHash<int, QByteArray> FileModel::roleNames() const
     roles.insert(SizeRole, QByteArray("size"));
     roles.insert(LastModifiedRole, QByteArray("modified"));
     roles.insert(CreatedRole, QByteArray("created"));
+    roles.insert(DirSizeRole, QByteArray("dirSize"));
+    roles.insert(ThumbnailRole, QByteArray("thumbnail"));
     return roles;
 }
 
 int FileModel::fileCount() const
 {
-    return m_files.count();
+    return m_rows.count();
 }
 
 QString FileModel::errorMessage() const
@@ -110,12 +229,12 @@ void FileModel::setDir(QString dir)
         return;
 
     // update watcher to watch the new directory
-    if (!m_dir.isEmpty())
-        m_watcher->removePath(m_dir);
-    if (!dir.isEmpty())
-        m_watcher->addPath(dir);
+    DirWatcher::instance()->removeDir(m_dir);
+    DirWatcher::instance()->addDir(dir);
 
     m_dir = dir;
+    if (m_active)
+        MetadataCache::instance()->setLastDir(m_dir);
 
     readDirectory();
     m_dirty = false;
@@ -123,6 +242,68 @@ void FileModel::setDir(QString dir)
     emit dirChanged();
 }
 
+void FileModel::setRefreshDelay(int delay)
+{
+    if (m_refreshDelay == delay)
+        return;
+
+    m_refreshDelay = qMax(0, delay);
+    emit refreshDelayChanged();
+}
+
+void FileModel::setMaxRefreshDelay(int delay)
+{
+    if (m_maxRefreshDelay == delay)
+        return;
+
+    m_maxRefreshDelay = qMax(0, delay);
+    emit maxRefreshDelayChanged();
+}
+
+void FileModel::setSortBy(SortBy sortBy)
+{
+    if (m_sortBy == sortBy)
+        return;
+
+    m_sortBy = sortBy;
+    emit sortByChanged();
+
+    sortRows();
+
+    // sizes and times of all entries are needed, they are sorted again when read
+    if (needsAllStats() && !m_dir.isEmpty()) {
+        foreach (const FileData &data, m_files) {
+            if (!data.hasStat) {
+                refreshDirectory();
+                break;
+            }
+        }
+    }
+}
+
+void FileModel::setNameFilter(QString nameFilter)
+{
+    if (m_nameFilter == nameFilter)
+        return;
+
+    m_nameFilter = nameFilter;
+    emit nameFilterChanged();
+
+    // remove rows which don't match anymore and add the ones which now match
+    QVector<bool> removed(m_rows.count(), false);
+    for (int row = 0; row < m_rows.count(); ++row)
+        removed[row] = !matchesFilter(m_files.at(m_rows.at(row)));
+    removeRowsFor(removed);
+
+    QVector<int> added;
+    for (int i = 0; i < m_files.count(); ++i) {
+        if (m_rowOfFile.at(i) < 0 && matchesFilter(m_files.at(i)))
+            added.append(i);
+    }
+    insertRowsFor(added);
+    emit fileCountChanged();
+}
+
 QString FileModel::appendPath(QString dirName)
 {
     return QDir::cleanPath(QDir(m_dir).absoluteFilePath(dirName));
@@ -136,12 +317,91 @@ void FileModel::setActive(bool active)
     m_active = active;
     emit activeChanged();
 
-    if (m_dirty)
-        readDirectory();
+    if (!active) {
+        storeListing();
+        s_inactiveModels.append(this);
+        trimInactiveModels();
+    } else {
+        s_inactiveModels.removeAll(this);
+        MetadataCache::instance()->setLastDir(m_dir);
+    }
+
+    if (active && m_compacted)
+        restoreSnapshot();
+    else if (m_dirty)
+        refreshDirectory();
 
     m_dirty = false;
 }
 
+void FileModel::trimInactiveModels()
+{
+    int entries = 0;
+    foreach (FileModel *model, s_inactiveModels) {
+        if (!model->m_compacted)
+            entries += model->m_files.count();
+    }
+
+    // the models deactivated first are the deepest in the page stack
+    foreach (FileModel *model, s_inactiveModels) {
+        if (entries <= InactiveEntryBudget)
+            break;
+        if (model->m_compacted)
+            continue;
+        entries -= model->m_files.count();
+        model->compact();
+    }
+}
+
+void FileModel::compact()
+{
+    // a model which is still loading has nothing worth keeping
+    if (m_loading || !m_errorMessage.isEmpty())
+        return;
+
+    // the rows stay, so the view keeps its delegates and position, the entries are replaced
+    // by new ones with only the names and kinds, the full entries may still be in the cache
+    FileDataList snapshot;
+    snapshot.reserve(m_files.count());
+    foreach (const FileData &data, m_files) {
+        FileData light;
+        light.name = data.name;
+        light.kind = data.kind;
+        light.icon = data.icon;
+        snapshot.append(light);
+    }
+    m_files = snapshot;
+    ++m_statGeneration; // stats on the way would only fill them again
+    m_statRequested.clear();
+    m_statIndexes.clear();
+    m_statNames.clear();
+
+    struct stat st;
+    m_snapshotModified = stat(QFile::encodeName(m_dir).constData(), &st) == 0 ?
+                (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000 : -1;
+    m_compacted = true;
+}
+
+void FileModel::restoreSnapshot()
+{
+    m_compacted = false;
+
+    // unchanged directories get their data back from the cache without reading the disk
+    struct stat st;
+    qint64 dirModified = stat(QFile::encodeName(m_dir).constData(), &st) == 0 ?
+                (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000 : -1;
+    FileDataList files;
+    if (!m_dirty && dirModified == m_snapshotModified && !m_refreshing &&
+            MetadataCache::instance()->listing(m_dir, dirModified, files)) {
+        applyChanges(files);
+        emit fileCountChanged();
+        return;
+    }
+
+    // otherwise only the differences are applied, with the stats the dropped texts need
+    refreshDirectory(true);
+}
+
 QString FileModel::parentPath()
 {
     return QDir::cleanPath(QDir(m_dir).absoluteFilePath(".."));
@@ -149,61 +409,678 @@ QString FileModel::parentPath()
 
 QString FileModel::fileNameAt(int fileIndex)
 {
-    if (fileIndex < 0 || fileIndex >= m_files.count())
+    if (fileIndex < 0 || fileIndex >= m_rows.count())
         return QString();
 
-    return m_files.at(fileIndex).info.absoluteFilePath();
+    return QDir(m_dir).absoluteFilePath(m_files.at(m_rows.at(fileIndex)).name);
+}
+
+void FileModel::scheduleRefresh()
+{
+    MetadataCache::instance()->invalidate(m_dir);
+    FileIndex::instance()->markStale(m_dir);
+
+    // inactive models are just marked dirty, no need to wait
+    if (!m_active) {
+        m_dirty = true;
+        return;
+    }
+
+    m_fullRefreshPending = true;
+    startRefreshTimer();
+}
+
+void FileModel::entryChanged(QString dir, QString name, int change)
+{
+    // hidden files are not shown
+    if (dir != m_dir || name.startsWith('.'))
+        return;
+
+    MetadataCache::instance()->invalidate(m_dir);
+    FileIndex::instance()->markStale(m_dir);
+
+    if (!m_active) {
+        m_dirty = true;
+        return;
+    }
+
+    // the last change of a name counts, the entry is read to see what it is now
+    m_pendingChanges.insert(name, change != DirWatcher::EntryRemoved);
+    startRefreshTimer();
+}
+
+void FileModel::dirChanged(QString dir)
+{
+    if (dir == m_dir)
+        scheduleRefresh();
+}
+
+void FileModel::startRefreshTimer()
+{
+    if (!m_refreshTimer->isActive())
+        m_firstChange.start();
+
+    // restart the quiet period, but don't go past the max delay from the first change
+    qint64 remaining = qMax(m_maxRefreshDelay - m_firstChange.elapsed(), (qint64)0);
+    m_refreshTimer->start((int)qMin((qint64)m_refreshDelay, remaining));
+}
+
+void FileModel::refreshChanges()
+{
+    // a read in progress may have passed the changed names already
+    if (m_fullRefreshPending || m_loading || !m_active ||
+            m_pendingChanges.count() > MaxPendingChanges) {
+        refresh();
+        return;
+    }
+
+    QStringList updated;
+    QSet<QString> removed;
+    QHash<QString, bool>::const_iterator it;
+    for (it = m_pendingChanges.constBegin(); it != m_pendingChanges.constEnd(); ++it) {
+        if (it.value())
+            updated.append(it.key());
+        else
+            removed.insert(it.key());
+    }
+    m_pendingChanges.clear();
+
+    // removed rows go at once, created and modified entries are read in the background
+    if (!removed.isEmpty()) {
+        FileDataList files;
+        foreach (const FileData &data, m_files) {
+            if (!removed.contains(data.name))
+                files.append(data);
+        }
+        applyChanges(files);
+        emit fileCountChanged();
+    }
+
+    if (!updated.isEmpty()) {
+        ++m_pendingUpdates;
+        m_dirWorker->startUpdateEntries(m_dir, m_generation, updated);
+    } else {
+        storeListing();
+    }
+}
+
+void FileModel::applyEntryUpdates(int generation, QStringList names, FileDataList entries)
+{
+    // a read started after the update has the changes
+    if (generation != m_generation || m_refreshing)
+        return;
+
+    --m_pendingUpdates;
+    applyChanges(replaceEntries(m_files, names, entries));
+    emit fileCountChanged();
+
+    storeListing();
+}
+
+void FileModel::clearPendingChanges()
+{
+    m_refreshTimer->stop();
+    m_pendingChanges.clear();
+    m_fullRefreshPending = false;
+    m_pendingUpdates = 0;
 }
 
 void FileModel::refresh()
 {
+    clearPendingChanges();
+    MetadataCache::instance()->invalidate(m_dir);
+
     if (!m_active) {
         m_dirty = true;
         return;
     }
 
-    readDirectory();
+    refreshDirectory();
     m_dirty = false;
 }
 
 void FileModel::readDirectory()
 {
+    clearPendingChanges(); // everything is read anyway
+
     // wrapped in reset model methods to get views notified
     beginResetModel();
-
     m_files.clear();
+    m_fileIndexOfName.clear();
+    m_rows.clear();
+    m_rowOfFile.clear();
     m_errorMessage = "";
+    endResetModel();
 
-    if (!m_dir.isEmpty())
-        readEntries();
+    // results of a possibly running read are discarded when they arrive
+    ++m_generation;
+    m_refreshing = false;
+    m_refreshFiles.clear();
 
-    endResetModel();
+    ++m_statGeneration;
+    m_statTimer->stop();
+    m_statIndexes.clear();
+    m_statNames.clear();
+    m_statRequested.clear();
+    cancelDirSizes();
+    m_compacted = false;
+
+    FileDataList cached;
+    if (m_dir.isEmpty()) {
+        m_dirWorker->cancel();
+        setLoading(false);
+    } else if (cachedListing(cached)) {
+        // shown at once, so the first frame has the entries without waiting for the thread,
+        // the refresh stats them again, a snapshot may be from the previous start
+        appendEntries(m_generation, cached);
+        refreshDirectory();
+    } else {
+        setLoading(true);
+        m_dirWorker->startReadDir(m_dir, m_generation, needsAllStats());
+    }
+
+    emit fileCountChanged();
+    emit errorMessageChanged();
+}
+
+bool FileModel::cachedListing(FileDataList &files) const
+{
+    // the only stat of the directory in the gui thread, the cache is checked with its time
+    struct stat st;
+    if (stat(QFile::encodeName(m_dir).constData(), &st) != 0)
+        return false;
+    qint64 dirModified = (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+    if (!MetadataCache::instance()->listing(m_dir, dirModified, files))
+        return false;
+
+    // sorting by size or time needs the stats of all entries, the worker reads the missing ones
+    if (needsAllStats()) {
+        foreach (const FileData &data, files) {
+            if (!data.hasStat)
+                return false;
+        }
+    }
+    return true;
+}
+
+void FileModel::refreshDirectory(bool allStats)
+{
+    if (m_dir.isEmpty()) {
+        readDirectory();
+        return;
+    }
+
+    // current entries are kept until the new listing is complete
+    clearPendingChanges();
+    ++m_generation;
+    m_refreshing = true;
+    m_refreshFiles.clear();
+    setLoading(true);
+    m_dirWorker->startReadDir(m_dir, m_generation, allStats || needsAllStats());
+}
+
+void FileModel::appendEntries(int generation, FileDataList entries)
+{
+    if (generation != m_generation || entries.isEmpty())
+        return;
+
+    if (m_refreshing) {
+        m_refreshFiles.append(entries);
+        return;
+    }
+
+    int first = m_files.count();
+    m_files.append(entries);
+    m_fileIndexOfName.clear();
+    m_rowOfFile.resize(m_files.count());
+
+    QVector<int> added;
+    for (int i = first; i < m_files.count(); ++i) {
+        m_rowOfFile[i] = -1;
+        if (matchesFilter(m_files.at(i)))
+            added.append(i);
+    }
+    insertRowsFor(added);
     emit fileCountChanged();
+}
+
+void FileModel::readDone(int generation, QString errorMessage)
+{
+    if (generation != m_generation)
+        return;
+
+    if (m_refreshing) {
+        m_refreshing = false;
+        // on error, the directory is probably gone, so nothing is left to show
+        if (!errorMessage.isEmpty())
+            m_refreshFiles.clear();
+
+        // without stat, the listing has no sizes or times, so check the rows shown earlier
+        bool restat = !needsAllStats();
+        applyChanges(m_refreshFiles);
+        m_refreshFiles.clear();
+        emit fileCountChanged();
+        if (restat)
+            restatEntries();
+    }
+
+    m_errorMessage = errorMessage;
+    setLoading(false);
     emit errorMessageChanged();
+
+    storeListing();
+}
+
+void FileModel::storeListing()
+{
+    // only complete and up to date listings are stored
+    if (m_dir.isEmpty() || m_loading || !m_errorMessage.isEmpty() || m_dirty ||
+            m_refreshTimer->isActive() || m_pendingUpdates > 0)
+        return;
+
+    MetadataCache::instance()->storeListing(m_dir, m_files);
+}
+
+void FileModel::setLoading(bool loading)
+{
+    if (m_loading == loading)
+        return;
+
+    m_loading = loading;
+    emit loadingChanged();
+}
+
+bool FileModel::needsAllStats() const
+{
+    return m_sortBy == SortBySize || m_sortBy == SortByModified;
+}
+
+void FileModel::applyChanges(const FileDataList &files)
+{
+    QHash<QString, int> newIndexes;
+    newIndexes.reserve(files.count());
+    for (int i = 0; i < files.count(); ++i)
+        newIndexes.insert(files.at(i).name, i);
+
+    // remove rows which are not in the new listing
+    QVector<int> oldToNew(m_files.count());
+    for (int i = 0; i < m_files.count(); ++i)
+        oldToNew[i] = newIndexes.value(m_files.at(i).name, -1);
+
+    QVector<bool> removed(m_rows.count(), false);
+    for (int row = 0; row < m_rows.count(); ++row)
+        removed[row] = oldToNew.at(m_rows.at(row)) < 0;
+    removeRowsFor(removed);
+
+    // new entries replace the old ones, except unmodified entries keep their data and stats
+    FileDataList newFiles = files;
+    QVector<bool> existing(files.count(), false);
+    QVector<int> modified;
+    for (int i = 0; i < m_files.count(); ++i) {
+        int n = oldToNew.at(i);
+        if (n < 0)
+            continue;
+
+        existing[n] = true;
+        const FileData &oldData = m_files.at(i);
+        // entries of compacted models have no stats and sort keys, they are always replaced
+        if (isModified(oldData, files.at(n)) || (files.at(n).hasStat && !oldData.hasStat) ||
+                (files.at(n).collationKey && !oldData.collationKey)) {
+            m_statRequested.remove(oldData.name);
+            modified.append(n);
+        } else {
+            newFiles[n] = oldData;
+            if (files.at(n).statFromCache)
+                newFiles[n].statFromCache = true;
+        }
+    }
+
+    // the rows stay the same, only their indexes to the entries change
+    for (int row = 0; row < m_rows.count(); ++row)
+        m_rows[row] = oldToNew.at(m_rows.at(row));
+    m_files = newFiles;
+    m_fileIndexOfName.clear();
+    updateRowOfFile();
+
+    foreach (int n, modified) {
+        int row = m_rowOfFile.at(n);
+        if (row >= 0)
+            emit dataChanged(index(row), index(row));
+    }
+
+    QVector<int> added;
+    for (int n = 0; n < files.count(); ++n) {
+        if (!existing.at(n) && matchesFilter(m_files.at(n)))
+            added.append(n);
+    }
+    insertRowsFor(added);
+
+    // modified sizes or times may change the order
+    if (!modified.isEmpty() && m_sortBy != SortByName)
+        sortRows();
+}
+
+bool FileModel::isModified(const FileData &oldData, const FileData &newData) const
+{
+    if (oldData.inode != newData.inode || oldData.kind != newData.kind)
+        return true;
+
+    // without stat, the rest is compared when the stat has been read
+    if (!oldData.hasStat || !newData.hasStat)
+        return false;
+
+    return oldData.modified != newData.modified ||
+            oldData.size != newData.size ||
+            oldData.permissions != newData.permissions;
+}
+
+void FileModel::requestStat(int fileIndex) const
+{
+    const QString &name = m_files.at(fileIndex).name;
+    if (m_statRequested.contains(name))
+        return;
+
+    m_statRequested.insert(name);
+    m_statIndexes.append(fileIndex);
+    m_statNames.append(name);
+    if (!m_statTimer->isActive())
+        m_statTimer->start();
+}
+
+void FileModel::restatEntries()
+{
+    for (int i = 0; i < m_files.count(); ++i) {
+        const FileData &data = m_files.at(i);
+        if (data.hasStat && !m_statRequested.contains(data.name))
+            requestStat(i);
+    }
+}
+
+void FileModel::flushStatRequests()
+{
+    if (m_statNames.isEmpty())
+        return;
+
+    m_dirWorker->startStatEntries(m_dir, m_statGeneration, m_statIndexes, m_statNames);
+    m_statIndexes.clear();
+    m_statNames.clear();
+}
+
+void FileModel::applyStats(int generation, QList<int> fileIndexes, FileDataList entries)
+{
+    if (generation != m_statGeneration)
+        return;
+
+    bool changed = false;
+    for (int i = 0; i < entries.count(); ++i) {
+        const FileData &entry = entries.at(i);
+        m_statRequested.remove(entry.name);
+
+        // indexes may have changed if the directory was refreshed meanwhile
+        int fileIndex = findFileIndex(fileIndexes.at(i), entry.name);
+        if (fileIndex < 0)
+            continue;
+
+        // a failed stat is not retried, the watcher tells if the file is gone
+        FileData &data = m_files[fileIndex];
+        data.statFromCache = false;
+        if (!entry.hasStat)
+            continue;
+
+        FileData updated = entry;
+        updated.inode = data.inode; // inode and collation key come from the listing
+        updated.collationKey = data.collationKey;
+        if (data.hasStat && !isModified(data, updated))
+            continue;
+
+        data = updated;
+        changed = true;
+        int row = m_rowOfFile.at(fileIndex);
+        if (row >= 0)
+            emit dataChanged(index(row), index(row));
+    }
+
+    if (changed && m_sortBy != SortByName)
+        sortRows();
+}
+
+QString FileModel::dirSizeText(const FileData &data) const
+{
+    // empty until the size has been calculated, the modification time is needed for the cache
+    if (data.kind != 'd' || !data.hasStat)
+        return QString();
+
+    QString path = QDir(m_dir).absoluteFilePath(data.name);
+    qint64 size = DirSizeService::instance()->cachedSize(path, data.modified);
+    if (size >= 0)
+        return filesizeToString(size);
+
+    if (!m_dirSizeRequested.contains(path)) {
+        m_dirSizeRequested.insert(path);
+        DirSizeService::instance()->requestSize(path);
+    }
+    return QString();
 }
 
-void FileModel::readEntries()
+void FileModel::updateDirSize(QString path, qint64 size)
 {
-    QDir dir(m_dir);
-    if (!dir.exists()) {
-        m_errorMessage = tr("Directory does not exist");
+    Q_UNUSED(size);
+    if (!m_dirSizeRequested.remove(path))
+        return; // requested by someone else
+
+    int fileIndex = findFileIndex(-1, QFileInfo(path).fileName());
+    if (fileIndex < 0)
         return;
+
+    int row = m_rowOfFile.at(fileIndex);
+    if (row >= 0)
+        emit dataChanged(index(row), index(row));
+}
+
+QString FileModel::thumbnailSource(const FileData &data) const
+{
+    // empty until the thumbnail exists, the modification time is needed to check it
+    if (data.icon != ImageIcon || !data.hasStat)
+        return QString();
+
+    QString path = QDir(m_dir).absoluteFilePath(data.name);
+    qint64 modified = data.modified / 1000;
+    if (ThumbnailService::instance()->isReady(path, modified))
+        return "image://thumbnail/" + QString::fromLatin1(QUrl::toPercentEncoding(path));
+
+    ThumbnailService::instance()->request(path, modified);
+    return QString();
+}
+
+void FileModel::updateThumbnail(QString path)
+{
+    QFileInfo info(path);
+    if (info.absolutePath() != QDir::cleanPath(QDir(m_dir).absolutePath()))
+        return;
+
+    int fileIndex = findFileIndex(-1, info.fileName());
+    if (fileIndex < 0)
+        return;
+
+    int row = m_rowOfFile.at(fileIndex);
+    if (row >= 0)
+        emit dataChanged(index(row), index(row));
+}
+
+void FileModel::cancelThumbnail(QString filename)
+{
+    ThumbnailService::instance()->cancel(QDir(m_dir).absoluteFilePath(filename));
+}
+
+void FileModel::cancelDirSizes()
+{
+    // sizes of the previous directory are not needed anymore
+    foreach (QString path, m_dirSizeRequested)
+        DirSizeService::instance()->cancel(path);
+    m_dirSizeRequested.clear();
+}
+
+int FileModel::findFileIndex(int hint, const QString &name) const
+{
+    if (hint >= 0 && hint < m_files.count() && m_files.at(hint).name == name)
+        return hint;
+
+    // built when needed, the entries change less often than sizes and thumbnails arrive
+    if (m_fileIndexOfName.isEmpty()) {
+        m_fileIndexOfName.reserve(m_files.count());
+        for (int i = 0; i < m_files.count(); ++i)
+            m_fileIndexOfName.insert(m_files.at(i).name, i);
     }
-    QByteArray ba = m_dir.toLatin1();
-    char *dirname = ba.data();
-    if (access(dirname, R_OK) == -1) {
-        m_errorMessage = tr("No permission to read the directory");
+    return m_fileIndexOfName.value(name, -1);
+}
+
+bool FileModel::lessThan(int fileIndex1, int fileIndex2) const
+{
+    const FileData &d1 = m_files.at(fileIndex1);
+    const FileData &d2 = m_files.at(fileIndex2);
+
+    switch (m_sortBy) {
+    case SortBySize:
+        if (d1.size != d2.size)
+            return d1.size > d2.size;
+        break;
+
+    case SortByModified:
+        if (d1.modified != d2.modified)
+            return d1.modified > d2.modified;
+        break;
+
+    case SortByType: {
+        if ((d1.kind == 'd') != (d2.kind == 'd'))
+            return d1.kind == 'd';
+        int r = suffixRef(d1.name).compare(suffixRef(d2.name), Qt::CaseInsensitive);
+        if (r != 0)
+            return r < 0;
+        break;
+    }
+
+    case SortByName:
+        break;
+    }
+
+    // names are the secondary key for the other sort orders
+    if (d1.collationKey && d2.collationKey)
+        return d1.collationKey->compare(*d2.collationKey) < 0;
+    return QString::compare(d1.name, d2.name, Qt::CaseInsensitive) < 0;
+}
+
+bool FileModel::matchesFilter(const FileData &data) const
+{
+    return m_nameFilter.isEmpty() || data.name.contains(m_nameFilter, Qt::CaseInsensitive);
+}
+
+void FileModel::insertRowsFor(QVector<int> fileIndexes)
+{
+    if (fileIndexes.isEmpty())
+        return;
+
+    FileIndexLessThan less(this);
+    qStableSort(fileIndexes.begin(), fileIndexes.end(), less);
+
+    // merge the sorted indexes to the rows in one pass, new entries go after equal rows,
+    // consecutive new entries make a group which is inserted together
+    QVector<int> merged;
+    merged.reserve(m_rows.count() + fileIndexes.count());
+    QVector<int> groupRows;
+    QVector<int> groupSizes;
+    int i = 0;
+    for (int row = 0; row <= m_rows.count(); ++row) {
+        int first = i;
+        while (i < fileIndexes.count() &&
+               (row == m_rows.count() || less(fileIndexes.at(i), m_rows.at(row))))
+            merged.append(fileIndexes.at(i++));
+        if (i > first) {
+            groupRows.append(merged.count() - (i - first));
+            groupSizes.append(i - first);
+        }
+        if (row < m_rows.count())
+            merged.append(m_rows.at(row));
+    }
+
+    // few groups are inserted as rows, so the view keeps its delegates
+    if (groupRows.count() <= MaxInsertGroups) {
+        for (int g = 0; g < groupRows.count(); ++g) {
+            int row = groupRows.at(g);
+            beginInsertRows(QModelIndex(), row, row + groupSizes.at(g) - 1);
+            m_rows.insert(row, groupSizes.at(g), 0);
+            for (int j = 0; j < groupSizes.at(g); ++j)
+                m_rows[row + j] = merged.at(row + j);
+            endInsertRows();
+        }
+        updateRowOfFile();
         return;
     }
 
-    QFileInfoList infoList = dir.entryInfoList();
-    foreach (QFileInfo info, infoList) {
-        QString filename = info.fileName();
-        if (filename == "." || filename == "..")
+    // otherwise the rows are replaced at once, persistent indexes follow their entries
+    emit layoutAboutToBeChanged();
+    QModelIndexList oldIndexes = persistentIndexList();
+    QVector<int> oldFileIndexes;
+    foreach (const QModelIndex &index, oldIndexes)
+        oldFileIndexes.append(m_rows.at(index.row()));
+
+    m_rows = merged;
+    updateRowOfFile();
+
+    QModelIndexList newIndexes;
+    foreach (int fileIndex, oldFileIndexes)
+        newIndexes.append(index(m_rowOfFile.at(fileIndex)));
+    changePersistentIndexList(oldIndexes, newIndexes);
+    emit layoutChanged();
+}
+
+void FileModel::removeRowsFor(const QVector<bool> &removed)
+{
+    // contiguous rows are removed together, from the end so row numbers stay valid
+    bool changed = false;
+    for (int last = m_rows.count()-1; last >= 0; --last) {
+        if (!removed.at(last))
             continue;
+        int first = last;
+        while (first > 0 && removed.at(first-1))
+            --first;
 
-        FileData data;
-        data.info = info;
-        m_files.append(data);
+        beginRemoveRows(QModelIndex(), first, last);
+        m_rows.remove(first, last - first + 1);
+        endRemoveRows();
+        changed = true;
+        last = first;
     }
+    if (changed)
+        updateRowOfFile();
+}
+
+void FileModel::sortRows()
+{
+    if (m_rows.isEmpty())
+        return;
+
+    emit layoutAboutToBeChanged();
+
+    // persistent indexes follow their entries to the new rows
+    QModelIndexList oldIndexes = persistentIndexList();
+    QVector<int> oldFileIndexes;
+    foreach (const QModelIndex &index, oldIndexes)
+        oldFileIndexes.append(m_rows.at(index.row()));
+
+    qStableSort(m_rows.begin(), m_rows.end(), FileIndexLessThan(this));
+    updateRowOfFile();
+
+    QModelIndexList newIndexes;
+    foreach (int fileIndex, oldFileIndexes)
+        newIndexes.append(index(m_rowOfFile.at(fileIndex)));
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit layoutChanged();
+}
+
+void FileModel::updateRowOfFile()
+{
+    m_rowOfFile.fill(-1, m_files.count());
+    for (int row = 0; row < m_rows.count(); ++row)
+        m_rowOfFile[m_rows.at(row)] = row;
 }
@@ -3,13 +3,15 @@
 
 #include <QAbstractListModel>
 #include <QDir>
-#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include "filedata.h"
 
-// struct to hold data for a single file
-struct FileData
-{
-    QFileInfo info;
-};
+class DirWorker;
 
 /**
  * @brief The FileModel class can be used as a model in a ListView to display a list of files
@@ -18,16 +20,56 @@ struct FileData
  * It also actively monitors the directory. If the directory changes, then the model is
  * updated automatically if active is true. If active is false, then the directory is
  * updated when active becomes true.
+ * The directory is read in a background thread and entries are added to the model in
+ * batches. The loading property is true while entries are still being read.
+ * Refreshing compares the new listing to the current one and only inserts, removes or
+ * updates the rows which have changed, so views keep their delegates and scroll position.
+ * The directory is watched by the shared DirWatcher, which tells the changed names. Removed
+ * entries are removed directly and only created or modified entries are read, the whole
+ * directory is read again only if the changes are not known or there are very many of them.
+ * Change notifications are coalesced: the refresh happens when no notifications have arrived
+ * for refreshDelay milliseconds, but at the latest maxRefreshDelay milliseconds after the
+ * first notification, so the view is updated also during long file operations.
+ * Only names and kinds are read with the listing. Size, permissions and times are stat-ed
+ * in the background when a view first asks for them, so only the visible rows are stat-ed.
+ * Rows can be sorted and filtered by name. The entries are stored in the order they were
+ * read and the rows are an index permutation of them, so sorting and filtering only change
+ * the permutation. Names are sorted with collation keys computed when reading.
+ * The dirSize role gives the total size of a directory. It is calculated by the shared
+ * DirSizeService when a view asks for it, and is empty until then.
+ * Similarly, the thumbnail role gives an image source for images, once ThumbnailService
+ * has created the thumbnail.
+ * Complete listings are stored in the MetadataCache, so a new model for the same directory
+ * and FileInfo get them without reading the disk. Change notifications invalidate them.
+ * The cached stats are only a hint: the worker stats the entries again after sending them,
+ * and the changes are applied like those of a refresh.
+ * A cached listing is shown at once when the directory is set, like the one of the last
+ * shown directory, which the cache loads at the start. The directory is refreshed after it.
+ * Inactive models share a memory budget. When it is exceeded, the models deactivated first
+ * drop the texts and stats of their entries and keep only names, kinds and sort keys.
+ * When such a model becomes active again, the data comes from the cache if the directory
+ * has not changed, otherwise the directory is refreshed.
  */
 class FileModel : public QAbstractListModel
 {
     Q_OBJECT
+    Q_ENUMS(SortBy)
     Q_PROPERTY(QString dir READ dir() WRITE setDir(QString) NOTIFY dirChanged())
     Q_PROPERTY(int fileCount READ fileCount() NOTIFY fileCountChanged())
     Q_PROPERTY(QString errorMessage READ errorMessage() NOTIFY errorMessageChanged())
     Q_PROPERTY(bool active READ active() WRITE setActive(bool) NOTIFY activeChanged())
+    Q_PROPERTY(bool loading READ loading() NOTIFY loadingChanged())
+    Q_PROPERTY(int refreshDelay READ refreshDelay() WRITE setRefreshDelay(int) NOTIFY refreshDelayChanged())
+    Q_PROPERTY(int maxRefreshDelay READ maxRefreshDelay() WRITE setMaxRefreshDelay(int) NOTIFY maxRefreshDelayChanged())
+    Q_PROPERTY(SortBy sortBy READ sortBy() WRITE setSortBy(SortBy) NOTIFY sortByChanged())
+    Q_PROPERTY(QString nameFilter READ nameFilter() WRITE setNameFilter(QString) NOTIFY nameFilterChanged())
 
 public:
+    // size and modified sort biggest and newest first, type sorts directories first
+    enum SortBy {
+        SortByName, SortBySize, SortByModified, SortByType
+    };
+
     explicit FileModel(QObject *parent = 0);
     ~FileModel();
 
@@ -43,33 +85,118 @@ public:
     QString errorMessage() const;
     bool active() const { return m_active; }
     void setActive(bool active);
+    bool loading() const { return m_loading; }
+    int refreshDelay() const { return m_refreshDelay; }
+    void setRefreshDelay(int delay);
+    int maxRefreshDelay() const { return m_maxRefreshDelay; }
+    void setMaxRefreshDelay(int delay);
+    SortBy sortBy() const { return m_sortBy; }
+    void setSortBy(SortBy sortBy);
+    QString nameFilter() const { return m_nameFilter; }
+    void setNameFilter(QString nameFilter);
 
     // methods accessible from QML
     Q_INVOKABLE QString appendPath(QString dirName);
     Q_INVOKABLE QString parentPath();
     Q_INVOKABLE QString fileNameAt(int fileIndex);
     Q_INVOKABLE void refresh();
+    // called when the row of the file is not shown anymore
+    Q_INVOKABLE void cancelThumbnail(QString filename);
 
 signals:
     void dirChanged();
     void fileCountChanged();
     void errorMessageChanged();
     void activeChanged();
+    void loadingChanged();
+    void refreshDelayChanged();
+    void maxRefreshDelayChanged();
+    void sortByChanged();
+    void nameFilterChanged();
 
 private slots:
+    void scheduleRefresh();
+    void entryChanged(QString dir, QString name, int change);
+    void dirChanged(QString dir);
+    void refreshChanges();
+    void applyEntryUpdates(int generation, QStringList names, FileDataList entries);
     void readDirectory();
+    void refreshDirectory(bool allStats = false);
+    void appendEntries(int generation, FileDataList entries);
+    void readDone(int generation, QString errorMessage);
+    void flushStatRequests();
+    void applyStats(int generation, QList<int> fileIndexes, FileDataList entries);
+    void updateDirSize(QString path, qint64 size);
+    void updateThumbnail(QString path);
 
 private:
-    void readEntries();
+    friend class FileIndexLessThan;
+
+    void setLoading(bool loading);
+    void startRefreshTimer();
+    void clearPendingChanges();
+    bool needsAllStats() const;
+    bool cachedListing(FileDataList &files) const;
+    void applyChanges(const FileDataList &files);
+    bool isModified(const FileData &oldData, const FileData &newData) const;
+    void requestStat(int fileIndex) const;
+    void restatEntries();
+    int findFileIndex(int hint, const QString &name) const;
+    QString dirSizeText(const FileData &data) const;
+    QString thumbnailSource(const FileData &data) const;
+    void cancelDirSizes();
+    void storeListing();
+
+    // memory budget of inactive models
+    static void trimInactiveModels();
+    void compact();
+    void restoreSnapshot();
+
+    // row permutation handling
+    bool lessThan(int fileIndex1, int fileIndex2) const;
+    bool matchesFilter(const FileData &data) const;
+    void insertRowsFor(QVector<int> fileIndexes);
+    void removeRowsFor(const QVector<bool> &removed);
+    void sortRows();
+    void updateRowOfFile();
 
     QString m_dir;
-    QList<FileData> m_files;
+    FileDataList m_files; // entries in the order they were read
+    QVector<int> m_rows; // indexes to m_files in sorted order, filtered out entries are left out
+    QVector<int> m_rowOfFile; // inverse of m_rows, -1 for filtered out entries
+    mutable QHash<QString, int> m_fileIndexOfName; // indexes to m_files, empty until needed
+    FileDataList m_refreshFiles; // new listing collected while refreshing
+    bool m_refreshing;
     QString m_errorMessage;
     bool m_active;
     bool m_dirty;
-    QFileSystemWatcher *m_watcher;
-};
+    bool m_loading;
+    int m_generation; // incremented for each read, used to discard results of stale reads
+    SortBy m_sortBy;
+    QString m_nameFilter;
+    bool m_compacted; // inactive and only the names and kinds kept to save memory
+    qint64 m_snapshotModified; // modification time of the directory when compacted
+
+    // changes from the watcher waiting for the refresh timer, name to true if it must be read
+    // and false if it was removed
+    QHash<QString, bool> m_pendingChanges;
+    bool m_fullRefreshPending; // the changes are not known, so everything is read
+    int m_pendingUpdates; // update reads started and not yet applied
 
+    // entries waiting to be stat-ed, mutable because they are requested in data()
+    int m_statGeneration; // incremented when the directory is read from scratch
+    mutable QList<int> m_statIndexes;
+    mutable QStringList m_statNames;
+    mutable QSet<QString> m_statRequested; // names requested but not stat-ed yet
+    QTimer *m_statTimer;
 
+    mutable QSet<QString> m_dirSizeRequested; // paths of directories sizes are calculated for
+
+    QTimer *m_refreshTimer;
+    QElapsedTimer m_firstChange; // time of the first change notification not yet refreshed
+    int m_refreshDelay;
+    int m_maxRefreshDelay;
+    DirWorker *m_dirWorker;
+};
 
 #endif // FILEMODEL_H
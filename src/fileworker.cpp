@@ -1,12 +1,174 @@
 #include "fileworker.h"
 #include <QDateTime>
+#include <QMutexLocker>
 #include "globals.h"
+#include "copyqueue.h"
+#include "crc32c.h"
+#include "copyjournal.h"
+#include "perftrace.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+// bytes copied at a time, cancel and progress are checked between the chunks
+static const size_t CopyChunkSize = 2 * 1024 * 1024;
+// minimum time between progress signals (milliseconds)
+static const int ProgressInterval = 200;
+// buffer for copying with read and write, if the kernel can't copy the file
+static const int CopyBufferSize = 1024 * 1024;
+// bytes copied between syncs that record the offset of a file in the journal
+static const qint64 JournalInterval = 64 * 1024 * 1024;
+// fat stores modification times in 2 second steps (nsecs)
+static const qint64 FatModifyWindow = 2000000000LL;
+
+// files waiting for the copy threads, bounds memory use while walking big trees
+static const int CopyQueueSize = 256;
+// default copy thread counts for internal storage and memory cards
+static const int InternalCopyThreads = 4;
+static const int MemoryCardCopyThreads = 2;
+
+// file system magic numbers of the file systems used on memory cards
+static const long MsdosSuperMagic = 0x4d44;
+static const long ExfatSuperMagic = 0x2011bab0;
+static const long FuseSuperMagic = 0x65735546;
+
+// size of the file or -1 if it does not exist
+static qint64 fileSize(const QString &path)
+{
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0)
+        return -1;
+    return st.st_size;
+}
+
+// in-kernel copy methods, tried in this order
+enum KernelCopyMethod {
+    CopyFileRange, SendFile, NoKernelCopy
+};
+
+// copies up to count bytes from the current file offsets without going through user space,
+// returns the bytes copied, 0 at end of file or -1 with errno set,
+// moves to the next method if the current one is not supported for these files
+static ssize_t kernelCopy(int in, int out, size_t count, KernelCopyMethod &method)
+{
+    forever {
+        ssize_t n = -1;
+        switch (method) {
+        case CopyFileRange:
+#ifdef SYS_copy_file_range
+            n = syscall(SYS_copy_file_range, in, (loff_t *)0, out, (loff_t *)0, count, 0);
+            break;
+#else
+            errno = ENOSYS;
+            break;
+#endif
+        case SendFile:
+            n = sendfile(out, in, 0, count);
+            break;
+        case NoKernelCopy:
+            errno = ENOSYS;
+            return -1;
+        }
+
+        if (n >= 0)
+            return n;
+        if (errno == EINTR)
+            continue;
+        if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)
+            return -1;
+
+        method = (KernelCopyMethod)(method + 1);
+    }
+}
+
+// name of a journaled copy until it is complete
+static QString partPath(const QString &dest)
+{
+    return dest + ".part";
+}
+
+static bool isOnMemoryCard(QString path)
+{
+    struct statfs fs;
+    if (statfs(QFile::encodeName(path).constData(), &fs) != 0)
+        return false;
+
+    long type = (long)fs.f_type;
+    return type == MsdosSuperMagic || type == ExfatSuperMagic || type == FuseSuperMagic;
+}
+
+static int defaultCopyThreadCount(QString destDirectory)
+{
+    return isOnMemoryCard(destDirectory) ? MemoryCardCopyThreads : InternalCopyThreads;
+}
+
+static qint64 modifiedNsecs(const struct stat &st)
+{
+    return (qint64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+/**
+ * @brief CopyThread copies files from the queue until it is closed or aborted.
+ */
+class CopyThread : public QThread
+{
+public:
+    CopyThread(FileWorker *worker, CopyQueue *queue) : m_worker(worker), m_queue(queue) {}
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        CopyItem item;
+        while (m_queue->pop(item)) {
+            if (m_worker->m_cancelled.loadAcquire() == FileWorker::Cancelled) {
+                m_worker->setCopyError(FileWorker::tr("Cancelled"), item.topLevel);
+                m_queue->abort();
+                return;
+            }
+
+            m_worker->setProgressFilename(QFileInfo(item.src).fileName());
+            QString errmsg = m_worker->copyOverwrite(item.src, item.dest);
+            if (errmsg.isEmpty() && m_worker->m_removeSources)
+                errmsg = m_worker->removeCopiedSource(item.src, item.dest);
+            if (!errmsg.isEmpty()) {
+                m_worker->setCopyError(errmsg, item.topLevel);
+                m_queue->abort(); // stops the walker and the other threads
+                return;
+            }
+        }
+    }
+
+private:
+    FileWorker *m_worker;
+    CopyQueue *m_queue;
+};
 
 FileWorker::FileWorker(QObject *parent) :
     QThread(parent),
     m_mode(DeleteMode),
     m_cancelled(KeepRunning),
-    m_progress(0)
+    m_copyThreadCount(0),
+    m_verifyCopies(0),
+    m_verify(false),
+    m_skipUnchangedFiles(0),
+    m_skipUnchanged(false),
+    m_modifyWindow(0),
+    m_progress(0),
+    m_removeSources(false),
+    m_journal(0),
+    m_storageFull(0),
+    m_bytesTotal(0),
+    m_bytesDone(0),
+    m_reportedBytes(0),
+    m_bytesPerSecond(0)
 {
 }
 
@@ -14,18 +176,18 @@ FileWorker::~FileWorker()
 {
 }
 
-void FileWorker::startDeleteFiles(QStringList filenames)
+bool FileWorker::startDeleteFiles(QStringList filenames)
 {
     if (isRunning()) {
-        emit errorOccurred(tr("File operation already in progress"), "");
-        return;
+        emit errorOccurred(tr("File operation already in progress"), "", false);
+        return false;
     }
 
     // basic validity check
     foreach (QString filename, filenames) {
         if (filename.isEmpty()) {
-            emit errorOccurred(tr("Empty filename"), "");
-            return;
+            emit errorOccurred(tr("Empty filename"), "", false);
+            return false;
         }
     }
 
@@ -33,20 +195,21 @@ void FileWorker::startDeleteFiles(QStringList filenames)
     m_filenames = filenames;
     m_cancelled.storeRelease(KeepRunning);
     start();
+    return true;
 }
 
-void FileWorker::startCopyFiles(QStringList filenames, QString destDirectory)
+bool FileWorker::startCopyFiles(QStringList filenames, QString destDirectory)
 {
     if (isRunning()) {
-        emit errorOccurred(tr("File operation already in progress"), "");
-        return;
+        emit errorOccurred(tr("File operation already in progress"), "", false);
+        return false;
     }
 
     // basic validity check
     foreach (QString filename, filenames) {
         if (filename.isEmpty()) {
-            emit errorOccurred(tr("Empty filename"), "");
-            return;
+            emit errorOccurred(tr("Empty filename"), "", false);
+            return false;
         }
     }
 
@@ -55,20 +218,21 @@ void FileWorker::startCopyFiles(QStringList filenames, QString destDirectory)
     m_destDirectory = destDirectory;
     m_cancelled.storeRelease(KeepRunning);
     start();
+    return true;
 }
 
-void FileWorker::startMoveFiles(QStringList filenames, QString destDirectory)
+bool FileWorker::startMoveFiles(QStringList filenames, QString destDirectory)
 {
     if (isRunning()) {
-        emit errorOccurred(tr("File operation already in progress"), "");
-        return;
+        emit errorOccurred(tr("File operation already in progress"), "", false);
+        return false;
     }
 
     // basic validity check
     foreach (QString filename, filenames) {
         if (filename.isEmpty()) {
-            emit errorOccurred(tr("Empty filename"), "");
-            return;
+            emit errorOccurred(tr("Empty filename"), "", false);
+            return false;
         }
     }
 
@@ -77,6 +241,22 @@ void FileWorker::startMoveFiles(QStringList filenames, QString destDirectory)
     m_destDirectory = destDirectory;
     m_cancelled.storeRelease(KeepRunning);
     start();
+    return true;
+}
+
+void FileWorker::setCopyThreadCount(int count)
+{
+    m_copyThreadCount.storeRelease(qMax(0, count));
+}
+
+void FileWorker::setVerifyCopies(bool verify)
+{
+    m_verifyCopies.storeRelease(verify ? 1 : 0);
+}
+
+void FileWorker::setSkipUnchanged(bool skip)
+{
+    m_skipUnchangedFiles.storeRelease(skip ? 1 : 0);
 }
 
 void FileWorker::cancel()
@@ -86,6 +266,7 @@ void FileWorker::cancel()
 
 void FileWorker::run() Q_DECL_OVERRIDE
 {
+    m_storageFull.storeRelease(0);
     switch (m_mode) {
     case DeleteMode:
         deleteFiles();
@@ -98,31 +279,118 @@ void FileWorker::run() Q_DECL_OVERRIDE
     }
 }
 
-QString FileWorker::deleteFile(QString filename)
+QString FileWorker::errnoString(int err)
 {
-    QFileInfo info(filename);
-    if (!info.exists())
-        return tr("File not found");
+    // the message is localized, so a full storage is told to the view with a flag
+    if (err == ENOSPC || err == EDQUOT)
+        m_storageFull.storeRelease(1);
+    return QString::fromLocal8Bit(strerror(err));
+}
+
+bool FileWorker::storageFull() const
+{
+    return m_storageFull.loadAcquire() != 0;
+}
+
+QString FileWorker::deleteFile(QString filename, QString &failedPath)
+{
+    // links are deleted, not the files they point to
+    QByteArray path = QFile::encodeName(filename);
+    struct stat st;
+    if (lstat(path.constData(), &st) != 0) {
+        int err = errno;
+        failedPath = filename;
+        return err == ENOENT ? tr("File not found") : errnoString(err);
+    }
 
-    if (info.isDir()) {
-        // this should be custom function to get better error reporting
-        bool ok = QDir(info.absoluteFilePath()).removeRecursively();
-        if (!ok)
-            return tr("Directory delete failed");
+    if (S_ISDIR(st.st_mode))
+        return deleteDirRecursively(AT_FDCWD, path, path, failedPath);
 
-    } else {
-        QFile file(info.absoluteFilePath());
-        bool ok = file.remove();
-        if (!ok)
-            return file.errorString();
+    if (unlink(path.constData()) != 0) {
+        failedPath = filename;
+        return errnoString(errno);
     }
+    PERF_COUNT(DeleteEntry, 1);
     return QString();
 }
 
+QString FileWorker::deleteDirRecursively(int parentFd, const QByteArray &name,
+                                         const QByteArray &path, QString &failedPath)
+{
+    // entries are deleted relative to the directory fd, the path is only for errors
+    int fd = openat(parentFd, name.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    if (fd < 0) {
+        failedPath = QFile::decodeName(path);
+        return errnoString(errno);
+    }
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        int err = errno;
+        close(fd);
+        failedPath = QFile::decodeName(path);
+        return errnoString(err);
+    }
+
+    QString errmsg;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != 0) {
+        const char *entName = ent->d_name;
+        if (strcmp(entName, ".") == 0 || strcmp(entName, "..") == 0)
+            continue;
+
+        // stop if cancelled
+        if (m_cancelled.loadAcquire() == Cancelled) {
+            failedPath = QFile::decodeName(path);
+            errmsg = tr("Cancelled");
+            break;
+        }
+
+        bool isDir = ent->d_type == DT_DIR;
+        if (ent->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = fstatat(fd, entName, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        if (isDir) {
+            errmsg = deleteDirRecursively(fd, QByteArray(entName), path + '/' + entName,
+                                          failedPath);
+        } else if (unlinkat(fd, entName, 0) != 0) {
+            errmsg = errnoString(errno);
+            failedPath = QFile::decodeName(path + '/' + entName);
+        } else {
+            PERF_COUNT(DeleteEntry, 1);
+        }
+        if (!errmsg.isEmpty())
+            break;
+
+        reportDeleteProgress(entName);
+    }
+    closedir(dir);
+
+    if (errmsg.isEmpty() && unlinkat(parentFd, name.constData(), AT_REMOVEDIR) != 0) {
+        errmsg = errnoString(errno);
+        failedPath = QFile::decodeName(path);
+    } else if (errmsg.isEmpty()) {
+        PERF_COUNT(DeleteEntry, 1);
+    }
+    return errmsg;
+}
+
+void FileWorker::reportDeleteProgress(const char *name)
+{
+    // percent is by the selected files, the name shows which entry is being deleted
+    if (m_reportTimer.elapsed() < ProgressInterval)
+        return;
+
+    m_reportTimer.restart();
+    emit progressChanged(m_progress, QFile::decodeName(name));
+}
+
 void FileWorker::deleteFiles()
 {
     int fileIndex = 0;
     int fileCount = m_filenames.count();
+    m_reportTimer.start();
 
     foreach (QString filename, m_filenames) {
         m_progress = 100 * fileIndex / fileCount;
@@ -130,14 +398,15 @@ void FileWorker::deleteFiles()
 
         // stop if cancelled
         if (m_cancelled.loadAcquire() == Cancelled) {
-            emit errorOccurred(tr("Cancelled"), filename);
+            emit errorOccurred(tr("Cancelled"), filename, false);
             return;
         }
 
         // delete file and stop if errors
-        QString errMsg = deleteFile(filename);
+        QString failedPath;
+        QString errMsg = deleteFile(filename, failedPath);
         if (!errMsg.isEmpty()) {
-            emit errorOccurred(errMsg, filename);
+            emit errorOccurred(errMsg, failedPath, storageFull());
             return;
         }
 
@@ -150,10 +419,29 @@ void FileWorker::deleteFiles()
 }
 
 void FileWorker::copyOrMoveFiles()
+{
+    m_progressFilename.clear();
+    m_bytesTotal = 0;
+    m_bytesDone = 0;
+    m_reportedBytes = 0;
+    m_bytesPerSecond = 0;
+    m_verify = m_verifyCopies.loadAcquire() != 0;
+    m_skipUnchanged = m_skipUnchangedFiles.loadAcquire() != 0;
+    m_modifyWindow = isOnMemoryCard(m_destDirectory) ? FatModifyWindow : 0;
+
+    if (m_mode == MoveMode)
+        moveFiles();
+    else
+        copyFiles(m_filenames);
+}
+
+void FileWorker::moveFiles()
 {
     int fileIndex = 0;
     int fileCount = m_filenames.count();
 
+    // rename what can be renamed, files on other file systems are copied and deleted after it
+    QStringList crossDeviceFiles;
     QDir dest(m_destDirectory);
     foreach (QString filename, m_filenames) {
         m_progress = 100 * fileIndex / fileCount;
@@ -161,46 +449,144 @@ void FileWorker::copyOrMoveFiles()
 
         // stop if cancelled
         if (m_cancelled.loadAcquire() == Cancelled) {
-            emit errorOccurred(tr("Cancelled"), filename);
+            emit errorOccurred(tr("Cancelled"), filename, false);
             return;
         }
 
-        // check destination does not exists, otherwise copy/move fails
+        // check destination does not exist, rename() would overwrite it
         QFileInfo fileInfo(filename);
         QString newname = dest.absoluteFilePath(fileInfo.fileName());
+        QByteArray destPath = QFile::encodeName(newname);
+        struct stat st;
+        if (lstat(destPath.constData(), &st) == 0) {
+            emit errorOccurred(tr("Destination file exists"), filename, false);
+            return;
+        }
 
-        // move or copy and stop if errors
-        QFile file(filename);
-        if (m_mode == MoveMode) {
-            if (!file.rename(newname)) {
-                emit errorOccurred(file.errorString(), filename);
+        // move and stop if errors
+        if (rename(QFile::encodeName(filename).constData(), destPath.constData()) != 0) {
+            if (errno != EXDEV) {
+                QString errMsg = errnoString(errno);
+                emit errorOccurred(errMsg, filename, storageFull());
                 return;
             }
-        } else {
-            if (fileInfo.isDir()) {
-                QString errmsg = copyDirRecursively(filename, newname);
-                if (!errmsg.isEmpty()) {
-                    emit errorOccurred(errmsg, filename);
-                    return;
-                }
-            } else {
-                QString errmsg = copyOverwrite(filename, newname);
-                if (!errmsg.isEmpty()) {
-                    emit errorOccurred(errmsg, filename);
-                    return;
-                }
-            }
+            crossDeviceFiles.append(filename);
         }
 
         fileIndex++;
     }
 
+    if (!crossDeviceFiles.isEmpty()) {
+        m_removeSources = true;
+        copyFiles(crossDeviceFiles);
+        m_removeSources = false;
+        return;
+    }
+
     m_progress = 100;
     emit progressChanged(m_progress, "");
     emit done();
 }
 
-QString FileWorker::copyDirRecursively(QString srcDirectory, QString destDirectory)
+void FileWorker::copyFiles(QStringList filenames)
+{
+    // count the bytes to copy, so progress can be reported in bytes
+    foreach (QString filename, filenames) {
+        if (m_cancelled.loadAcquire() == Cancelled) {
+            emit errorOccurred(tr("Cancelled"), filename, false);
+            return;
+        }
+        m_bytesTotal += countBytes(filename);
+    }
+    if (m_verify)
+        m_bytesTotal *= 2; // every byte is read again
+    m_progress = 0;
+    m_reportTimer.start();
+
+    m_copyError.clear();
+    m_copyErrorFilename.clear();
+
+    int threadCount = m_copyThreadCount.loadAcquire();
+    if (threadCount <= 0)
+        threadCount = defaultCopyThreadCount(m_destDirectory);
+
+    // a journal left by an interrupted run of the same job tells what has been copied
+    CopyJournal journal;
+    if (journal.open(m_mode == MoveMode, m_filenames, m_destDirectory))
+        m_journal = &journal;
+
+    CopyQueue queue(CopyQueueSize);
+    QList<CopyThread *> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        CopyThread *thread = new CopyThread(this, &queue);
+        thread->start();
+        threads.append(thread);
+    }
+
+    // walk the sources in this thread, directories are created before their files are queued
+    QDir dest(m_destDirectory);
+    foreach (QString filename, filenames) {
+        if (m_cancelled.loadAcquire() == Cancelled) {
+            setCopyError(tr("Cancelled"), filename);
+            break;
+        }
+
+        QFileInfo fileInfo(filename);
+        QString newname = dest.absoluteFilePath(fileInfo.fileName());
+        QString errmsg;
+        if (m_removeSources && fileInfo.isSymLink())
+            errmsg = moveLink(filename, newname);
+        else if (fileInfo.isDir())
+            errmsg = queueDirRecursively(filename, newname, filename, queue);
+        else if (!queue.push(CopyItem(filename, newname, filename)))
+            errmsg = tr("Cancelled"); // aborted by a copy thread, which set the real error
+
+        if (!errmsg.isEmpty()) {
+            setCopyError(errmsg, filename);
+            break;
+        }
+    }
+
+    if (hasCopyError())
+        queue.abort();
+    else
+        queue.close();
+
+    foreach (CopyThread *thread, threads) {
+        thread->wait();
+        delete thread;
+    }
+
+    // the files have been moved, so only empty source directories are left
+    if (m_removeSources && !hasCopyError()) {
+        foreach (QString filename, filenames) {
+            QFileInfo fileInfo(filename);
+            if (fileInfo.isSymLink() || !fileInfo.isDir())
+                continue;
+            QString errmsg = removeEmptyDirs(filename);
+            if (!errmsg.isEmpty()) {
+                setCopyError(errmsg, filename);
+                break;
+            }
+        }
+    }
+
+    m_journal = 0;
+    if (hasCopyError()) {
+        emit errorOccurred(m_copyError, m_copyErrorFilename, storageFull());
+        return;
+    }
+    journal.remove();
+
+    m_progress = 100;
+    emit progressChanged(m_progress, "");
+    if (m_bytesTotal > 0)
+        emit transferProgressChanged(m_bytesDone, m_bytesTotal, (qint64)m_bytesPerSecond);
+    emit done();
+}
+
+QString FileWorker::queueDirRecursively(QString srcDirectory, QString destDirectory,
+                                        QString topLevel, CopyQueue &queue)
 {
     QDir srcDir(srcDirectory);
     if (!srcDir.exists())
@@ -214,34 +600,39 @@ QString FileWorker::copyDirRecursively(QString srcDirectory, QString destDirecto
             return tr("Can't create target directory %1").arg(destDirectory);
     }
 
-    // copy files
-    QStringList names = srcDir.entryList(QDir::Files);
+    // queue files for the copy threads
+    QStringList names = srcDir.entryList(QDir::Files | extraFilters());
     for (int i = 0 ; i < names.count() ; ++i) {
         // stop if cancelled
         if (m_cancelled.loadAcquire() == Cancelled)
             return tr("Cancelled");
 
         QString filename = names.at(i);
-        emit progressChanged(m_progress, filename);
         QString spath = srcDir.absoluteFilePath(filename);
         QString dpath = destDir.absoluteFilePath(filename);
-        QString errmsg = copyOverwrite(spath, dpath);
-        if (!errmsg.isEmpty())
-            return errmsg;
+        if (m_removeSources && QFileInfo(spath).isSymLink()) {
+            QString errmsg = moveLink(spath, dpath);
+            if (!errmsg.isEmpty())
+                return errmsg;
+            continue;
+        }
+        if (!queue.push(CopyItem(spath, dpath, topLevel)))
+            return tr("Cancelled"); // aborted by a copy thread, which set the real error
     }
 
-    // copy dirs
-    names = srcDir.entryList(QDir::NoDotAndDotDot | QDir::AllDirs);
+    // walk dirs
+    names = srcDir.entryList(QDir::NoDotAndDotDot | QDir::AllDirs | extraFilters());
     for (int i = 0 ; i < names.count() ; ++i) {
         // stop if cancelled
         if (m_cancelled.loadAcquire() == Cancelled)
             return tr("Cancelled");
 
         QString filename = names.at(i);
-        emit progressChanged(m_progress, filename);
         QString spath = srcDir.absoluteFilePath(filename);
         QString dpath = destDir.absoluteFilePath(filename);
-        QString errmsg = copyDirRecursively(spath, dpath);
+        // moving must not follow links, their targets would be deleted
+        QString errmsg = m_removeSources && QFileInfo(spath).isSymLink() ?
+                    moveLink(spath, dpath) : queueDirRecursively(spath, dpath, topLevel, queue);
         if (!errmsg.isEmpty())
             return errmsg;
     }
@@ -249,17 +640,483 @@ QString FileWorker::copyDirRecursively(QString srcDirectory, QString destDirecto
     return QString();
 }
 
+void FileWorker::setCopyError(QString message, QString filename)
+{
+    // the first error is reported, following errors are usually caused by it
+    QMutexLocker locker(&m_errorMutex);
+    if (!m_copyError.isEmpty())
+        return;
+
+    m_copyError = message;
+    m_copyErrorFilename = filename;
+}
+
+bool FileWorker::hasCopyError()
+{
+    QMutexLocker locker(&m_errorMutex);
+    return !m_copyError.isEmpty();
+}
+
 QString FileWorker::copyOverwrite(QString src, QString dest)
 {
+    struct stat st;
+    bool hasStat = stat(QFile::encodeName(src).constData(), &st) == 0;
+
+    // already in the destination, for instance from an earlier backup
+    if (m_skipUnchanged && hasStat && isUnchanged(src, dest, st)) {
+        addBytesDone(m_verify ? 2 * st.st_size : st.st_size);
+        return QString();
+    }
+
+    if (m_journal && hasStat) {
+        // copied by an earlier run of the job
+        if (m_journal->isComplete(src, st) && fileSize(dest) == st.st_size) {
+            addBytesDone(m_verify ? 2 * st.st_size : st.st_size);
+            return QString();
+        }
+
+        // continued from what the earlier run wrote, verifying needs the crc of all data
+        qint64 offset = m_verify ? 0 : m_journal->resumeOffset(src, st);
+        if (offset > 0 && fileSize(partPath(dest)) >= offset)
+            return copyFile(src, dest, offset);
+    }
+
+    // a journaled copy replaces the destination only when it is complete
     QFile dfile(dest);
-    if (dfile.exists()) {
+    if (!m_journal && dfile.exists()) {
         if (!dfile.remove())
             return dfile.errorString();
     }
 
-    QFile sfile(src);
-    if (!sfile.copy(dest))
-        return sfile.errorString();
+    return copyFile(src, dest, 0);
+}
+
+bool FileWorker::isUnchanged(const QString &src, const QString &dest, const struct stat &srcStat)
+{
+    struct stat destStat;
+    if (stat(QFile::encodeName(dest).constData(), &destStat) != 0 || !S_ISREG(destStat.st_mode) ||
+            destStat.st_size != srcStat.st_size ||
+            qAbs(modifiedNsecs(destStat) - modifiedNsecs(srcStat)) > m_modifyWindow)
+        return false;
+    // a moved source is deleted after this, so the size and time are not enough then
+    if (!m_verify && !m_removeSources)
+        return true;
+
+    // both files are local, so comparing the bytes costs the same as comparing checksums
+    int in = open(QFile::encodeName(src).constData(), O_RDONLY);
+    if (in < 0)
+        return false;
+    int out = open(QFile::encodeName(dest).constData(), O_RDONLY);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+    bool same = sameContent(in, out);
+    close(in);
+    close(out);
+    return same;
+}
+
+bool FileWorker::sameContent(int fd1, int fd2)
+{
+    posix_fadvise(fd1, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd2, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // the files have the same size, so a short read of one ends the comparison
+    QByteArray buffer1(CopyBufferSize, Qt::Uninitialized);
+    QByteArray buffer2(CopyBufferSize, Qt::Uninitialized);
+    forever {
+        if (m_cancelled.loadAcquire() == Cancelled)
+            return false;
+
+        ssize_t n1 = read(fd1, buffer1.data(), buffer1.size());
+        if (n1 <= 0)
+            return n1 == 0 && read(fd2, buffer2.data(), 1) == 0;
+
+        ssize_t n2 = 0;
+        while (n2 < n1) {
+            ssize_t n = read(fd2, buffer2.data() + n2, n1 - n2);
+            if (n <= 0)
+                return false;
+            n2 += n;
+        }
+        if (memcmp(buffer1.constData(), buffer2.constData(), n1) != 0)
+            return false;
+    }
+}
+
+QString FileWorker::removeCopiedSource(QString src, QString dest)
+{
+    // check the copy before the only other copy of the data is deleted
+    struct stat srcStat, destStat;
+    QByteArray srcPath = QFile::encodeName(src);
+    if (stat(srcPath.constData(), &srcStat) != 0 ||
+            stat(QFile::encodeName(dest).constData(), &destStat) != 0)
+        return errnoString(errno);
+    if (srcStat.st_size != destStat.st_size)
+        return tr("File size changed while moving");
+
+    if (unlink(srcPath.constData()) != 0)
+        return errnoString(errno);
+    return QString();
+}
+
+QString FileWorker::moveLink(QString src, QString dest)
+{
+    // the link itself is moved, not the file it points to
+    QByteArray srcPath = QFile::encodeName(src);
+    QByteArray target(PATH_MAX, Qt::Uninitialized);
+    ssize_t length = readlink(srcPath.constData(), target.data(), target.size() - 1);
+    if (length < 0)
+        return errnoString(errno);
+    target.truncate(length);
+
+    QByteArray destPath = QFile::encodeName(dest);
+    unlink(destPath.constData());
+    if (symlink(target.constData(), destPath.constData()) != 0)
+        return errnoString(errno);
+    if (unlink(srcPath.constData()) != 0)
+        return errnoString(errno);
+    return QString();
+}
+
+QString FileWorker::removeEmptyDirs(QString dirname)
+{
+    // links have been moved already, so the subdirectories are real directories
+    QDir dir(dirname);
+    foreach (QString name, dir.entryList(QDir::NoDotAndDotDot | QDir::AllDirs | QDir::Hidden)) {
+        QString errmsg = removeEmptyDirs(dir.absoluteFilePath(name));
+        if (!errmsg.isEmpty())
+            return errmsg;
+    }
+
+    // fails if something was left, for instance a special file which can't be copied
+    if (rmdir(QFile::encodeName(dirname).constData()) != 0)
+        return errnoString(errno);
+    return QString();
+}
+
+QDir::Filters FileWorker::extraFilters() const
+{
+    // moving must not leave hidden files behind
+    return m_removeSources ? QDir::Hidden : QDir::Filters();
+}
+
+QString FileWorker::copyFile(QString src, QString dest, qint64 resumeOffset)
+{
+    int in = open(QFile::encodeName(src).constData(), O_RDONLY);
+    if (in < 0)
+        return errnoString(errno);
+
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        int err = errno;
+        close(in);
+        return errnoString(err);
+    }
+
+    // a journaled copy is written to a temporary name, so a cancelled one does not look complete
+    QByteArray finalPath = QFile::encodeName(dest);
+    QByteArray destPath = m_journal ? QFile::encodeName(partPath(dest)) : finalPath;
+    int flags = (m_verify ? O_RDWR : O_WRONLY) | O_CREAT | (resumeOffset > 0 ? 0 : O_TRUNC);
+    int out = open(destPath.constData(), flags, 0600);
+    if (out < 0) {
+        int err = errno;
+        close(in);
+        return errnoString(err);
+    }
+
+    // anything after the offset may not have reached the disk, so it is written again
+    QString errmsg;
+    if (resumeOffset > 0) {
+        if (ftruncate(out, resumeOffset) != 0 || lseek(in, resumeOffset, SEEK_SET) < 0 ||
+                lseek(out, resumeOffset, SEEK_SET) < 0)
+            errmsg = errnoString(errno);
+        else
+            addBytesDone(resumeOffset);
+    }
+
+    // the data is needed here when calculating the crc, so the kernel can't copy it
+    quint32 crc = 0;
+    CopyState state;
+    state.src = src;
+    state.st = st;
+    state.crc = m_verify ? &crc : 0;
+    state.method = m_verify ? NoKernelCopy : CopyFileRange;
+    state.unsynced = 0;
+    if (errmsg.isEmpty())
+        errmsg = copyData(in, out, state);
+
+    // permissions and times are set on the open file, a sync compares the times later
+    if (errmsg.isEmpty() && fchmod(out, st.st_mode & 07777) != 0)
+        errmsg = errnoString(errno);
+    if (errmsg.isEmpty()) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        if (futimens(out, times) != 0)
+            errmsg = errnoString(errno);
+    }
+    if (errmsg.isEmpty() && m_verify)
+        errmsg = verifyCopy(destPath, out, crc);
+
+    // a cancelled copy can be resumed, so its written part is kept
+    bool keepPartial = !errmsg.isEmpty() && m_journal &&
+            m_cancelled.loadAcquire() == Cancelled;
+    if (keepPartial)
+        checkpoint(out, state);
+
+    close(in);
+    if (close(out) != 0 && errmsg.isEmpty())
+        errmsg = errnoString(errno);
+
+    if (errmsg.isEmpty() && destPath != finalPath &&
+            rename(destPath.constData(), finalPath.constData()) != 0)
+        errmsg = errnoString(errno);
+
+    // don't leave partial files behind
+    if (!errmsg.isEmpty() && !keepPartial)
+        unlink(destPath.constData());
+    if (errmsg.isEmpty() && m_journal)
+        m_journal->setComplete(src, st);
+
+    return errmsg;
+}
+
+// state of copying one file in a copy thread
+struct FileWorker::CopyState
+{
+    QString src;
+    struct stat st; // of the source when it was opened
+    quint32 *crc; // 0 if not verifying
+    KernelCopyMethod method;
+    qint64 unsynced; // bytes written since the last journal checkpoint
+};
+
+QString FileWorker::copyData(int in, int out, CopyState &state)
+{
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // a file with fewer blocks than its size has holes, only its data regions are copied
+    const struct stat &st = state.st;
+    off_t pos = lseek(in, 0, SEEK_CUR);
+    if ((qint64)st.st_blocks * 512 >= st.st_size || pos < 0)
+        return copyRange(in, out, -1, state);
+
+    QByteArray zeros;
+    while (pos < st.st_size) {
+        off_t data = lseek(in, pos, SEEK_DATA);
+        if (data < 0 && errno == ENXIO) {
+            data = st.st_size; // only a hole is left
+        } else if (data < 0) {
+            // holes can't be found on this file system
+            if (lseek(in, pos, SEEK_SET) < 0)
+                return errnoString(errno);
+            return copyRange(in, out, -1, state);
+        }
+        data = qMin(data, (off_t)st.st_size);
+        off_t hole = data < st.st_size ? lseek(in, data, SEEK_HOLE) : data;
+        if (hole < 0)
+            return errnoString(errno);
+        hole = qMin(hole, (off_t)st.st_size);
+
+        // a hole reads as zeros, so they are in the checksum and in the progress
+        qint64 holeLength = data - pos;
+        if (holeLength > 0) {
+            if (state.crc && zeros.isEmpty())
+                zeros.fill(0, CopyBufferSize);
+            while (state.crc && holeLength > 0) {
+                int n = (int)qMin(holeLength, (qint64)zeros.size());
+                *state.crc = crc32c(*state.crc, zeros.constData(), n);
+                holeLength -= n;
+            }
+            addBytesDone(data - pos);
+        }
+        if (data >= st.st_size)
+            break;
+
+        if (lseek(in, data, SEEK_SET) < 0 || lseek(out, data, SEEK_SET) < 0)
+            return errnoString(errno);
+        QString errmsg = copyRange(in, out, hole - data, state);
+        if (!errmsg.isEmpty())
+            return errmsg;
+        pos = hole;
+    }
+
+    // a hole at the end is made by setting the size, data appended after the stat is copied too
+    if (ftruncate(out, st.st_size) != 0 || lseek(in, st.st_size, SEEK_SET) < 0 ||
+            lseek(out, st.st_size, SEEK_SET) < 0)
+        return errnoString(errno);
+    return copyRange(in, out, -1, state);
+}
 
+QString FileWorker::copyRange(int in, int out, qint64 length, CopyState &state)
+{
+    // copies length bytes or to the end of the file if length is negative
+    qint64 copied = 0;
+    while (state.method != NoKernelCopy && (length < 0 || copied < length)) {
+        if (m_cancelled.loadAcquire() == Cancelled)
+            return tr("Cancelled");
+
+        size_t count = length < 0 ? CopyChunkSize : (size_t)qMin(length - copied, (qint64)CopyChunkSize);
+        ssize_t n = kernelCopy(in, out, count, state.method);
+        // files in /proc and /sys report end of file to the kernel copy, so read them
+        if (n == 0 && copied == 0)
+            break;
+        if (n == 0)
+            return QString();
+        if (n < 0) {
+            if (state.method == NoKernelCopy)
+                break;
+            return errnoString(errno);
+        }
+        copied += n;
+        addBytesDone(n);
+        PERF_COUNT(CopyBytes, n);
+        state.unsynced += n;
+        if (m_journal && state.unsynced >= JournalInterval)
+            checkpoint(out, state);
+    }
+
+    // fall back to read and write with a large buffer, continues from the current offsets
+    QByteArray buffer;
+    while (length < 0 || copied < length) {
+        if (m_cancelled.loadAcquire() == Cancelled)
+            return tr("Cancelled");
+
+        if (buffer.isEmpty())
+            buffer.resize(CopyBufferSize);
+        size_t count = length < 0 ? buffer.size() : (size_t)qMin(length - copied, (qint64)buffer.size());
+        ssize_t n = read(in, buffer.data(), count);
+        if (n == 0)
+            return QString();
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errnoString(errno);
+        }
+        if (state.crc)
+            *state.crc = crc32c(*state.crc, buffer.constData(), n);
+        copied += n;
+
+        const char *p = buffer.constData();
+        while (n > 0) {
+            ssize_t written = write(out, p, n);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return errnoString(errno);
+            }
+            p += written;
+            n -= written;
+            addBytesDone(written);
+            PERF_COUNT(CopyBytes, written);
+            state.unsynced += written;
+        }
+        if (m_journal && state.unsynced >= JournalInterval)
+            checkpoint(out, state);
+    }
     return QString();
 }
+
+void FileWorker::checkpoint(int out, CopyState &state)
+{
+    // the offset is recorded only after the data before it is on the disk
+    state.unsynced = 0;
+    off_t offset = lseek(out, 0, SEEK_CUR);
+    if (offset > 0 && fdatasync(out) == 0)
+        m_journal->setOffset(state.src, state.st, offset);
+}
+
+QString FileWorker::verifyCopy(const QByteArray &destPath, int out, quint32 crc)
+{
+    // written to the disk and dropped from the cache, so the data is read from the disk
+    if (fdatasync(out) != 0)
+        return errnoString(errno);
+    posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED);
+
+    if (lseek(out, 0, SEEK_SET) != 0)
+        return errnoString(errno);
+    posix_fadvise(out, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    QByteArray buffer(CopyBufferSize, Qt::Uninitialized);
+    quint32 destCrc = 0;
+    forever {
+        if (m_cancelled.loadAcquire() == Cancelled)
+            return tr("Cancelled");
+
+        ssize_t n = read(out, buffer.data(), buffer.size());
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errnoString(errno);
+        }
+        destCrc = crc32c(destCrc, buffer.constData(), n);
+        addBytesDone(n);
+    }
+
+    if (destCrc != crc)
+        return tr("Verification failed, the copy of %1 differs from the original")
+                .arg(QFile::decodeName(destPath));
+    return QString();
+}
+
+qint64 FileWorker::countBytes(QString filename)
+{
+    // uses the same filters as queueDirRecursively()
+    QFileInfo info(filename);
+    if (m_removeSources && info.isSymLink())
+        return 0; // links are moved, not copied
+    if (!info.isDir())
+        return info.size();
+
+    qint64 bytes = 0;
+    QDir dir(filename);
+    foreach (QFileInfo fileInfo, dir.entryInfoList(QDir::Files | extraFilters())) {
+        if (!m_removeSources || !fileInfo.isSymLink())
+            bytes += fileInfo.size();
+    }
+
+    foreach (QString name, dir.entryList(QDir::NoDotAndDotDot | QDir::AllDirs | extraFilters())) {
+        if (m_cancelled.loadAcquire() == Cancelled)
+            break;
+        bytes += countBytes(dir.absoluteFilePath(name));
+    }
+    return bytes;
+}
+
+void FileWorker::setProgressFilename(QString filename)
+{
+    QMutexLocker locker(&m_progressMutex);
+    m_progressFilename = filename;
+    reportProgress(false);
+}
+
+void FileWorker::addBytesDone(qint64 bytes)
+{
+    QMutexLocker locker(&m_progressMutex);
+    m_bytesDone += bytes;
+    reportProgress(false);
+}
+
+void FileWorker::reportProgress(bool force)
+{
+    // called with m_progressMutex locked
+    qint64 elapsed = m_reportTimer.elapsed();
+    if (!force && elapsed < ProgressInterval)
+        return;
+
+    // smooth the rate, so the time left does not jump around
+    if (elapsed > 0) {
+        double rate = (m_bytesDone - m_reportedBytes) * 1000.0 / elapsed;
+        m_bytesPerSecond = m_bytesPerSecond == 0 ? rate : 0.7 * m_bytesPerSecond + 0.3 * rate;
+    }
+    m_reportedBytes = m_bytesDone;
+    m_reportTimer.restart();
+
+    // files may grow while copying, so don't go over 100
+    if (m_bytesTotal > 0)
+        m_progress = (int)qMin(100 * m_bytesDone / m_bytesTotal, (qint64)100);
+    emit progressChanged(m_progress, m_progressFilename);
+    emit transferProgressChanged(m_bytesDone, m_bytesTotal, (qint64)m_bytesPerSecond);
+}
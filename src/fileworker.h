@@ -3,9 +3,37 @@
 
 #include <QThread>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <sys/stat.h>
+
+class CopyQueue;
+class CopyJournal;
 
 /**
  * @brief FileWorker does all file related work in the background.
+ * Files are copied by the kernel with copy_file_range() or sendfile() when possible,
+ * otherwise with a large buffer. Copies keep the permissions and times of their source. Holes
+ * of sparse files are found with SEEK_DATA and SEEK_HOLE and left as holes in the copy.
+ * When copying, the total size is counted first and progress is reported in bytes copied,
+ * at most every ProgressInterval milliseconds so the gui thread is not flooded.
+ * Copying is pipelined: this thread walks the directories and queues the files, and a small
+ * pool of copy threads copies them. The pool size can be set, by default it is smaller for
+ * memory cards, which are slow with parallel writes.
+ * Moving renames the files. Files on another file system are copied the same way and each
+ * source file is deleted as soon as its copy is complete, so extra space is needed for one
+ * file at a time only.
+ * In verify mode the data is copied through a buffer and its CRC-32C is calculated on the way,
+ * then the copy is written to the disk, dropped from the page cache and read back to compare.
+ * The source is read only once, progress counts the copied and the verified bytes.
+ * When skipping unchanged files, a destination file with the same size and modification time
+ * (and the same content when verifying or moving) is not copied again.
+ * Copies are recorded in a CopyJournal. If the same job is started again after a cancel or a
+ * crash, complete files are skipped and partly written files are continued from the last
+ * offset known to be on the disk. Files are written with a ".part" suffix and renamed when
+ * complete, so a cancelled copy leaves only the partial file for that.
+ * Directories are deleted natively with unlinkat() relative to directory fds, errors give the
+ * path of the entry that could not be deleted.
  */
 class FileWorker : public QThread
 {
@@ -16,23 +44,34 @@ public:
     ~FileWorker();
 
     // call these to start the thread, returns false if start failed
-    void startDeleteFiles(QStringList filenames);
-    void startCopyFiles(QStringList filenames, QString destDirectory);
-    void startMoveFiles(QStringList filenames, QString destDirectory);
+    bool startDeleteFiles(QStringList filenames);
+    bool startCopyFiles(QStringList filenames, QString destDirectory);
+    bool startMoveFiles(QStringList filenames, QString destDirectory);
+
+    // number of parallel copy threads, 0 selects it by the destination file system
+    void setCopyThreadCount(int count);
+    // checks each copied file by reading it back, applies to jobs started after this
+    void setVerifyCopies(bool verify);
+    // doesn't copy files which are already in the destination, applies to jobs started after this
+    void setSkipUnchanged(bool skip);
 
     void cancel();
 
 signals: // signals, can be connected from a thread to another
     void progressChanged(int progress, QString filename);
+    void transferProgressChanged(qint64 bytesDone, qint64 bytesTotal, qint64 bytesPerSecond);
 
     // one of these is emitted when thread ends
     void done();
-    void errorOccurred(QString message, QString filename);
+    // storageFull is true if a write failed because the destination file system is full
+    void errorOccurred(QString message, QString filename, bool storageFull);
 
 protected:
     void run();
 
 private:
+    friend class CopyThread;
+
     enum Mode {
         DeleteMode, CopyMode, MoveMode
     };
@@ -40,17 +79,66 @@ private:
         Cancelled = 0, KeepRunning = 1
     };
 
-    QString deleteFile(QString filenames);
+    QString errnoString(int err);
+    bool storageFull() const;
+    QString deleteFile(QString filename, QString &failedPath);
+    QString deleteDirRecursively(int parentFd, const QByteArray &name, const QByteArray &path,
+                                 QString &failedPath);
+    void reportDeleteProgress(const char *name);
     void deleteFiles();
     void copyOrMoveFiles();
-    QString copyDirRecursively(QString srcDirectory, QString destDirectory);
+    void moveFiles();
+    void copyFiles(QStringList filenames);
+    QString queueDirRecursively(QString srcDirectory, QString destDirectory, QString topLevel,
+                                CopyQueue &queue);
+    void setCopyError(QString message, QString filename);
+    bool hasCopyError();
     QString copyOverwrite(QString src, QString dest);
+    bool isUnchanged(const QString &src, const QString &dest, const struct stat &srcStat);
+    bool sameContent(int fd1, int fd2);
+    QString removeCopiedSource(QString src, QString dest);
+    QString moveLink(QString src, QString dest);
+    QString removeEmptyDirs(QString dirname);
+    QDir::Filters extraFilters() const;
+    QString copyFile(QString src, QString dest, qint64 resumeOffset);
+    struct CopyState;
+    QString copyData(int in, int out, CopyState &state);
+    QString copyRange(int in, int out, qint64 length, CopyState &state);
+    void checkpoint(int out, CopyState &state);
+    QString verifyCopy(const QByteArray &destPath, int out, quint32 crc);
+    qint64 countBytes(QString filename);
+    void setProgressFilename(QString filename);
+    void addBytesDone(qint64 bytes);
+    void reportProgress(bool force);
 
     FileWorker::Mode m_mode;
     QStringList m_filenames;
     QString m_destDirectory;
     QAtomicInt m_cancelled; // atomic so no locks needed
+    QAtomicInt m_copyThreadCount;
+    QAtomicInt m_verifyCopies;
+    bool m_verify; // m_verifyCopies when the job started
+    QAtomicInt m_skipUnchangedFiles;
+    bool m_skipUnchanged; // m_skipUnchangedFiles when the job started
+    qint64 m_modifyWindow; // nsecs modification times may differ in the destination file system
     int m_progress;
+    bool m_removeSources; // true when moving between file systems
+    CopyJournal *m_journal; // journal of the running copy, 0 if none
+    QAtomicInt m_storageFull; // set when an error is ENOSPC or EDQUOT, by any copy thread
+
+    // first error of the copy threads
+    QMutex m_errorMutex;
+    QString m_copyError;
+    QString m_copyErrorFilename;
+
+    // byte progress of copying, protected by the mutex because all copy threads update it
+    QMutex m_progressMutex;
+    QString m_progressFilename;
+    qint64 m_bytesTotal;
+    qint64 m_bytesDone;
+    qint64 m_reportedBytes; // bytes done when progress was last reported
+    double m_bytesPerSecond; // smoothed transfer rate
+    QElapsedTimer m_reportTimer;
 };
 
 #endif // FILEWORKER_H
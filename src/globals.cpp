@@ -1,25 +1,148 @@
 #include "globals.h"
 #include <QLocale>
+#include <string.h>
+
+// known suffixes in lower case, sorted for binary search
+struct SuffixIcon {
+    const char *suffix;
+    IconId icon;
+};
+static const SuffixIcon suffixIcons[] = {
+    { "aac", AudioIcon },
+    { "apk", ApkIcon },
+    { "avi", VideoIcon },
+    { "bmp", ImageIcon },
+    { "flac", AudioIcon },
+    { "gif", ImageIcon },
+    { "jpeg", ImageIcon },
+    { "jpg", ImageIcon },
+    { "m4a", AudioIcon },
+    { "mkv", VideoIcon },
+    { "mov", VideoIcon },
+    { "mp3", AudioIcon },
+    { "mp4", VideoIcon },
+    { "mpg", VideoIcon },
+    { "ogg", AudioIcon },
+    { "opus", AudioIcon },
+    { "png", ImageIcon },
+    { "rpm", RpmIcon },
+    { "txt", TextIcon },
+    { "wav", AudioIcon },
+    { "webm", VideoIcon },
+    { "webp", ImageIcon }
+};
+static const int MaxSuffixLength = 4;
+
+IconId suffixToIconId(const QChar *suffix, int length)
+{
+    if (length <= 0 || length > MaxSuffixLength)
+        return FileIcon;
+
+    // lower case latin1 copy on the stack, so nothing is allocated
+    char key[MaxSuffixLength + 1];
+    for (int i = 0; i < length; ++i) {
+        ushort c = suffix[i].unicode();
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c > 127)
+            return FileIcon;
+        key[i] = (char)c;
+    }
+    key[length] = 0;
+
+    int low = 0;
+    int high = sizeof(suffixIcons) / sizeof(suffixIcons[0]) - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int cmp = strcmp(key, suffixIcons[mid].suffix);
+        if (cmp == 0)
+            return suffixIcons[mid].icon;
+        if (cmp < 0)
+            high = mid - 1;
+        else
+            low = mid + 1;
+    }
+    return FileIcon;
+}
+
+IconId suffixToIconId(QString suffix)
+{
+    return suffixToIconId(suffix.constData(), suffix.length());
+}
+
+IconId fileNameToIconId(const QString &name)
+{
+    int i = name.lastIndexOf('.');
+    if (i < 0)
+        return FileIcon;
+    return suffixToIconId(name.constData() + i + 1, name.length() - i - 1);
+}
+
+IconId magicToIconId(const unsigned char *data, int length)
+{
+    // the magic numbers of the common types, the unknown suffixes are usually one of these
+    if (length >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0)
+        return ImageIcon;
+    if (length >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff)
+        return ImageIcon;
+    if (length >= 4 && memcmp(data, "GIF8", 4) == 0)
+        return ImageIcon;
+    if (length >= 12 && memcmp(data, "RIFF", 4) == 0) {
+        if (memcmp(data + 8, "WAVE", 4) == 0)
+            return AudioIcon;
+        if (memcmp(data + 8, "AVI ", 4) == 0)
+            return VideoIcon;
+        if (memcmp(data + 8, "WEBP", 4) == 0)
+            return ImageIcon;
+    }
+    if (length >= 4 && (memcmp(data, "fLaC", 4) == 0 || memcmp(data, "OggS", 4) == 0))
+        return AudioIcon;
+    if (length >= 3 && memcmp(data, "ID3", 3) == 0)
+        return AudioIcon;
+    if (length >= 2 && data[0] == 0xff && (data[1] & 0xe0) == 0xe0)
+        return AudioIcon; // mpeg audio frame sync
+    if (length >= 12 && memcmp(data + 4, "ftyp", 4) == 0)
+        return memcmp(data + 8, "M4A", 3) == 0 ? AudioIcon : VideoIcon;
+    if (length >= 4 && memcmp(data, "\x1a\x45\xdf\xa3", 4) == 0)
+        return VideoIcon; // matroska and webm
+    if (length >= 4 && memcmp(data, "\xed\xab\xee\xdb", 4) == 0)
+        return RpmIcon;
+
+    // text if there are no control characters other than white space
+    if (length == 0)
+        return FileIcon;
+    for (int i = 0; i < length; ++i) {
+        unsigned char c = data[i];
+        if (c < 32 && c != '\t' && c != '\n' && c != '\r' && c != '\f')
+            return FileIcon;
+    }
+    return TextIcon;
+}
+
+QString iconIdToName(IconId icon)
+{
+    // shared strings, so returning them does not allocate
+    static const QString names[] = {
+        "file", "folder", "link", "file-txt", "file-rpm", "file-apk",
+        "file-image", "file-audio", "file-video"
+    };
+    return names[icon];
+}
 
 QString suffixToIconName(QString suffix)
 {
-    if (suffix == "txt")
-        return "file-txt";
-    if (suffix == "rpm")
-        return "file-rpm";
-    if (suffix == "apk")
-        return "file-apk";
-    if (suffix == "png" || suffix == "jpeg" || suffix == "jpg" ||
-            suffix == "gif")
-        return "file-image";
-    if (suffix == "wav" || suffix == "mp3" || suffix == "flac" ||
-            suffix == "aac" || suffix == "ogg")
-        return "file-audio";
-    if (suffix == "mp4" || suffix == "mpg" || suffix == "avi" ||
-            suffix == "mov")
-        return "file-video";
-
-    return "file";
+    return iconIdToName(suffixToIconId(suffix));
+}
+
+QString fileKindToString(char kind)
+{
+    static const QString dir("d"), link("l"), file("-"), unknown("?");
+    switch (kind) {
+    case 'd': return dir;
+    case 'l': return link;
+    case '-': return file;
+    default: return unknown;
+    }
 }
 
 QString permissionsToString(QFile::Permissions permissions)
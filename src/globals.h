@@ -5,9 +5,20 @@
 #include <QDateTime>
 #include <QDir>
 
+// icon ids, iconIdToName() gives the name used in the image file names
+enum IconId {
+    FileIcon, FolderIcon, LinkIcon, TextIcon, RpmIcon, ApkIcon, ImageIcon, AudioIcon, VideoIcon
+};
+
 // Global functions
 
+IconId suffixToIconId(QString suffix);
+IconId suffixToIconId(const QChar *suffix, int length);
+IconId fileNameToIconId(const QString &name); // by suffix, without allocating
+IconId magicToIconId(const unsigned char *data, int length); // by the first bytes of a file
+QString iconIdToName(IconId icon);
 QString suffixToIconName(QString suffix);
+QString fileKindToString(char kind);
 QString permissionsToString(QFile::Permissions permissions);
 QString filesizeToString(qint64 filesize);
 QString datetimeToString(QDateTime datetime);
@@ -12,22 +12,41 @@
 
 #include "filemodel.h"
 #include "fileinfo.h"
+#include "searchmodel.h"
+#include "consolemodel.h"
 #include "engine.h"
+#include "metadatacache.h"
+#include "thumbnailprovider.h"
 
 int main(int argc, char *argv[])
 {
     qmlRegisterType<FileModel>("harbour.file.browser.FileModel", 1, 0, "FileModel");
     qmlRegisterType<FileInfo>("harbour.file.browser.FileInfo", 1, 0, "FileInfo");
+    qmlRegisterType<SearchModel>("harbour.file.browser.SearchModel", 1, 0, "SearchModel");
+    qmlRegisterType<ConsoleModel>("harbour.file.browser.ConsoleModel", 1, 0, "ConsoleModel");
 
     QScopedPointer<QGuiApplication> app(SailfishApp::application(argc, argv));
+
     QScopedPointer<QQuickView> view(SailfishApp::createView());
 
     // global engine object
     QScopedPointer<Engine> engine(new Engine);
     view->rootContext()->setContextProperty("engine", engine.data());
 
+    // the engine takes the ownership of the provider
+    view->engine()->addImageProvider("thumbnail", new ThumbnailProvider);
+
+    // the first page opens the directory shown last, its listing is in the cache already
+    QString startDir = MetadataCache::instance()->loadSnapshot();
+    view->rootContext()->setContextProperty("startDir", startDir);
+
     view->setSource(SailfishApp::pathTo("qml/main.qml"));
     view->show();
 
-    return app->exec();
+    int result = app->exec();
+
+    // the pages store their listings when deleted, then the last one is saved for the next start
+    view.reset();
+    MetadataCache::instance()->saveSnapshot();
+    return result;
 }
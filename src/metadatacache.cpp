@@ -0,0 +1,224 @@
+#include "metadatacache.h"
+#include <QDir>
+#include <QMutexLocker>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QCollator>
+#include <sys/stat.h>
+#include <stdio.h>
+
+// total number of entries in the cached listings
+static const int MaxCachedEntries = 20000;
+// bigger listings are not saved, loading them would slow down the start
+static const int MaxSnapshotEntries = 5000;
+// changed when the snapshot format changes, old snapshots are ignored
+static const quint32 SnapshotMagic = 0x46425331; // "FBS1"
+
+static QString snapshotPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+            "/harbour-file-browser/listing.snapshot";
+}
+
+static qint64 dirModifiedTime(const QString &dir)
+{
+    struct stat st;
+    if (stat(QFile::encodeName(dir).constData(), &st) != 0)
+        return -1;
+    return (qint64)st.st_mtim.tv_sec * 1000 + st.st_mtim.tv_nsec / 1000000;
+}
+
+MetadataCache *MetadataCache::instance()
+{
+    static MetadataCache cache;
+    return &cache;
+}
+
+MetadataCache::MetadataCache() :
+    m_listings(MaxCachedEntries)
+{
+}
+
+void MetadataCache::storeListing(QString dir, const FileDataList &files)
+{
+    dir = QDir::cleanPath(dir);
+    qint64 dirModified = dirModifiedTime(dir);
+    if (dirModified < 0)
+        return;
+
+    // the list is implicitly shared, so storing does not copy the entries
+    Listing *listing = new Listing;
+    listing->dirModified = dirModified;
+    listing->files = files;
+
+    QMutexLocker locker(&m_mutex);
+    m_listings.insert(dir, listing, files.count() + 1);
+}
+
+bool MetadataCache::listing(QString dir, qint64 dirModified, FileDataList &files)
+{
+    QMutexLocker locker(&m_mutex);
+    dir = QDir::cleanPath(dir);
+    Listing *listing = m_listings.object(dir);
+    if (!listing)
+        return false;
+
+    // entries were added or removed while nobody was watching
+    if (listing->dirModified != dirModified) {
+        m_listings.remove(dir);
+        return false;
+    }
+
+    files = listing->files;
+    return true;
+}
+
+bool MetadataCache::fileData(QString path, FileData &data)
+{
+    path = QDir::cleanPath(path);
+    int slash = path.lastIndexOf('/');
+    if (slash < 0)
+        return false;
+    QString dir = slash == 0 ? QString("/") : path.left(slash);
+    QString name = path.mid(slash + 1);
+
+    // the file may have been removed or rewritten since it was cached, its own stat tells,
+    // so the directory is not checked
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    Listing *listing = m_listings.object(dir);
+    if (!listing)
+        return false;
+
+    foreach (const FileData &file, listing->files) {
+        if (file.name == name) {
+            if (!file.hasStat || !file.matchesStat(st))
+                return false;
+            data = file;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MetadataCache::invalidate(QString dir)
+{
+    QMutexLocker locker(&m_mutex);
+    m_listings.remove(QDir::cleanPath(dir));
+}
+
+void MetadataCache::setLastDir(QString dir)
+{
+    QMutexLocker locker(&m_mutex);
+    m_lastDir = QDir::cleanPath(dir);
+}
+
+void MetadataCache::saveSnapshot()
+{
+    QString dir;
+    Listing listing;
+    bool found = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_lastDir.isEmpty())
+            return;
+        dir = m_lastDir;
+        Listing *cached = m_listings.object(dir);
+        if (cached) {
+            listing = *cached;
+            found = true;
+        }
+    }
+
+    // without a usable listing only the directory is saved, it is read as usual at the start
+    if (listing.files.count() > MaxSnapshotEntries)
+        found = false;
+    qint32 count = found ? listing.files.count() : -1;
+
+    QString path = snapshotPath();
+    if (!QDir().mkpath(QFileInfo(path).path()))
+        return;
+
+    // written to a temporary file first, so a crash never leaves a partial snapshot
+    QString tmp = path + ".tmp";
+    QFile file(tmp);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+
+    // the texts are saved too, so the start does not format times and sizes
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << SnapshotMagic << dir << (found ? listing.dirModified : (qint64)-1) << count;
+    for (int i = 0; i < count; ++i) {
+        const FileData &data = listing.files.at(i);
+        out << data.name << (qint8)data.kind << (qint32)data.icon << data.hasStat
+            << data.permissionsText << data.sizeText << data.modifiedText << data.createdText
+            << data.size << data.modified << (qint32)data.permissions << data.inode;
+    }
+    file.close();
+
+    // rename() replaces the old snapshot, QFile::rename() would fail when it exists
+    if (out.status() != QDataStream::Ok ||
+            rename(QFile::encodeName(tmp).constData(), QFile::encodeName(path).constData()) != 0)
+        QFile::remove(tmp);
+}
+
+QString MetadataCache::loadSnapshot()
+{
+    QFile file(snapshotPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    QString dir;
+    qint64 dirModified;
+    qint32 count;
+    in >> magic >> dir >> dirModified >> count;
+    if (in.status() != QDataStream::Ok || magic != SnapshotMagic || dir.isEmpty())
+        return QString();
+
+    // the directory is opened even if it has changed, then it is just read as usual
+    qint64 currentModified = dirModifiedTime(dir);
+    if (currentModified < 0)
+        return QString();
+    if (count < 0 || count > MaxSnapshotEntries || currentModified != dirModified)
+        return dir;
+
+    // sort keys are not saved, they are made like DirWorker makes them
+    QCollator collator;
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    collator.setNumericMode(true);
+
+    Listing *listing = new Listing;
+    listing->dirModified = dirModified;
+    listing->files.reserve(count);
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        FileData data;
+        qint8 kind;
+        qint32 icon;
+        qint32 permissions;
+        in >> data.name >> kind >> icon >> data.hasStat
+           >> data.permissionsText >> data.sizeText >> data.modifiedText >> data.createdText
+           >> data.size >> data.modified >> permissions >> data.inode;
+        data.kind = kind;
+        data.icon = (IconId)icon;
+        data.permissions = QFile::Permissions(QFlag(permissions));
+        data.collationKey = QSharedPointer<QCollatorSortKey>(
+                    new QCollatorSortKey(collator.sortKey(data.name)));
+        listing->files.append(data);
+    }
+    if (in.status() != QDataStream::Ok) {
+        delete listing;
+        return dir;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_listings.insert(dir, listing, count + 1);
+    return dir;
+}
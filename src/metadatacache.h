@@ -0,0 +1,53 @@
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include <QCache>
+#include <QMutex>
+#include "filedata.h"
+
+/**
+ * @brief MetadataCache keeps recently read directory listings for the whole process.
+ * Models store their listings with the stat data they have, so opening a directory again or
+ * showing the details of a file in it does not need to read the disk. The cache is bounded
+ * by the total number of entries and the least recently used listings are dropped first.
+ * Listings are invalidated when a model watching the directory sees a change. They are also
+ * checked against the modification time of the directory when read again.
+ * The listing of the last shown directory is saved to the disk at exit and loaded to the
+ * cache at the next start, so the first page can be shown without reading the directory.
+ * The cache can be used from any thread.
+ */
+class MetadataCache
+{
+public:
+    static MetadataCache *instance();
+
+    // stores the listing of a directory, replacing a previous one
+    void storeListing(QString dir, const FileDataList &files);
+    // gets the listing, returns false if it is not cached or the directory has changed
+    bool listing(QString dir, qint64 dirModified, FileDataList &files);
+    // gets the cached data of a file, returns false if it is not cached with stat data
+    // or the file has changed since
+    bool fileData(QString path, FileData &data);
+    void invalidate(QString dir);
+
+    // the directory shown last, its listing is saved by saveSnapshot()
+    void setLastDir(QString dir);
+    // writes the cached listing of the last directory to the disk
+    void saveSnapshot();
+    // loads the saved listing to the cache, returns its directory or an empty string
+    QString loadSnapshot();
+
+private:
+    struct Listing {
+        qint64 dirModified;
+        FileDataList files;
+    };
+
+    MetadataCache();
+
+    QMutex m_mutex;
+    QCache<QString, Listing> m_listings; // cost is the number of entries
+    QString m_lastDir;
+};
+
+#endif // METADATACACHE_H
@@ -0,0 +1,176 @@
+#include "perftrace.h"
+#include <QCoreApplication>
+#include <QMutex>
+#include <QTimer>
+
+// a sample is taken every second and a minute of samples is kept
+static const int SampleInterval = 1000;
+static const int SampleCount = 60;
+// the shown rates and averages are of the latest seconds
+static const int LiveSamples = 5;
+// the gui thread is considered stalled if the check timer is this late
+static const int StallCheckInterval = 100;
+static const int StallThreshold = 50;
+
+static PerfTrace *s_instance = 0;
+static QMutex s_mutex;
+
+QAtomicInt PerfTrace::s_enabled;
+PerfTrace::Totals PerfTrace::s_current;
+
+PerfTrace::Totals::Totals()
+{
+    for (int i = 0; i < ProbeCount; ++i) {
+        count[i] = 0;
+        nsecs[i] = 0;
+        maxNsecs[i] = 0;
+        value[i] = 0;
+    }
+}
+
+PerfTrace *PerfTrace::instance()
+{
+    if (!s_instance)
+        s_instance = new PerfTrace(QCoreApplication::instance());
+    return s_instance;
+}
+
+PerfTrace::PerfTrace(QObject *parent) :
+    QObject(parent),
+    m_samples(SampleCount),
+    m_nextSample(0),
+    m_sampleCount(0)
+{
+    m_sampleTimer = new QTimer(this);
+    m_sampleTimer->setInterval(SampleInterval);
+    connect(m_sampleTimer, SIGNAL(timeout()), this, SLOT(takeSample()));
+
+    m_stallTimer = new QTimer(this);
+    m_stallTimer->setInterval(StallCheckInterval);
+    connect(m_stallTimer, SIGNAL(timeout()), this, SLOT(checkStall()));
+
+    updateStats();
+}
+
+PerfTrace::~PerfTrace()
+{
+    s_enabled.storeRelease(0);
+    s_instance = 0;
+}
+
+bool PerfTrace::isAvailable()
+{
+#ifdef PERF_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PerfTrace::setEnabled(bool enabled)
+{
+    if (!isAvailable() || enabled == isEnabled())
+        return;
+
+    // samples are of one tracing session, so old values do not mix with new ones
+    {
+        QMutexLocker locker(&s_mutex);
+        s_current = Totals();
+    }
+    m_samples.fill(Totals());
+    m_nextSample = 0;
+    m_sampleCount = 0;
+
+    s_enabled.storeRelease(enabled ? 1 : 0);
+    if (enabled) {
+        m_sampleTimer->start();
+        m_stallTimer->start();
+        m_stallClock.start();
+    } else {
+        m_sampleTimer->stop();
+        m_stallTimer->stop();
+    }
+    updateStats();
+    emit statsChanged();
+}
+
+void PerfTrace::record(Probe probe, qint64 nsecs, qint64 value)
+{
+    QMutexLocker locker(&s_mutex);
+    ++s_current.count[probe];
+    s_current.nsecs[probe] += nsecs;
+    if (nsecs > s_current.maxNsecs[probe])
+        s_current.maxNsecs[probe] = nsecs;
+    s_current.value[probe] += value;
+}
+
+void PerfTrace::takeSample()
+{
+    {
+        QMutexLocker locker(&s_mutex);
+        m_samples[m_nextSample] = s_current;
+        s_current = Totals();
+    }
+    m_nextSample = (m_nextSample + 1) % SampleCount;
+    if (m_sampleCount < SampleCount)
+        ++m_sampleCount;
+
+    updateStats();
+    emit statsChanged();
+}
+
+void PerfTrace::checkStall()
+{
+    // a late timeout means the event loop was blocked
+    qint64 elapsed = m_stallClock.restart();
+    qint64 late = elapsed - StallCheckInterval;
+    if (late > StallThreshold)
+        record(GuiStall, late * 1000000, 0);
+}
+
+void PerfTrace::updateStats()
+{
+    m_stats.clear();
+    m_stats["available"] = isAvailable();
+    m_stats["enabled"] = isEnabled();
+    if (m_sampleCount == 0)
+        return;
+
+    // sums of the live samples, newest first
+    Totals live;
+    int liveCount = qMin(m_sampleCount, LiveSamples);
+    for (int i = 1; i <= liveCount; ++i) {
+        const Totals &sample = m_samples.at((m_nextSample - i + SampleCount) % SampleCount);
+        for (int p = 0; p < ProbeCount; ++p) {
+            live.count[p] += sample.count[p];
+            live.nsecs[p] += sample.nsecs[p];
+            live.maxNsecs[p] = qMax(live.maxNsecs[p], sample.maxNsecs[p]);
+            live.value[p] += sample.value[p];
+        }
+    }
+    double seconds = liveCount * SampleInterval / 1000.0;
+
+    // the longest stall is of the whole buffer, so it stays visible for a while
+    qint64 maxStall = 0;
+    for (int i = 0; i < m_sampleCount; ++i)
+        maxStall = qMax(maxStall, m_samples.at(i).maxNsecs[GuiStall]);
+
+    qint64 scans = live.count[DirRead];
+    m_stats["scans"] = scans;
+    m_stats["scanMs"] = scans > 0 ? live.nsecs[DirRead] / 1e6 / scans : 0.0;
+    m_stats["scanMaxMs"] = live.maxNsecs[DirRead] / 1e6;
+    m_stats["entriesPerScan"] = scans > 0 ? live.value[DirRead] / scans : 0;
+    m_stats["statsPerSecond"] = live.count[StatEntry] / seconds;
+    m_stats["dataCallsPerSecond"] = live.count[ModelData] / seconds;
+    m_stats["dataNsAvg"] = live.count[ModelData] > 0 ?
+                live.nsecs[ModelData] / live.count[ModelData] : 0;
+    m_stats["fileInfoReads"] = live.count[FileInfoRead];
+    m_stats["fileInfoMs"] = live.count[FileInfoRead] > 0 ?
+                live.nsecs[FileInfoRead] / 1e6 / live.count[FileInfoRead] : 0.0;
+    m_stats["copyMBps"] = live.value[CopyBytes] / seconds / (1024.0 * 1024.0);
+    m_stats["deletesPerSecond"] = live.count[DeleteEntry] / seconds;
+    m_stats["guiStalls"] = live.count[GuiStall];
+    m_stats["guiStallMs"] = live.nsecs[GuiStall] / 1e6;
+    m_stats["guiStallMaxMs"] = maxStall / 1e6;
+    m_stats["seconds"] = seconds;
+}
@@ -0,0 +1,114 @@
+#ifndef PERFTRACE_H
+#define PERFTRACE_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QVariantMap>
+#include <QVector>
+
+class QTimer;
+
+/**
+ * @brief PerfTrace collects durations, counts and bytes of the hot paths for a debug page.
+ * The probes are placed with the PERF_SCOPE() and PERF_COUNT() macros, which are empty unless
+ * PERF_TRACE is defined, which "qmake CONFIG+=perftrace" does, so normal builds have no
+ * tracing. The probes can be used from any thread and do nothing while tracing is disabled.
+ * When enabled, the totals are moved to a ring buffer of one second samples and summarized
+ * in stats(). A timer in the gui thread detects stalls of the event loop.
+ */
+class PerfTrace : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Probe {
+        DirRead, // reading a directory listing, value is the entry count
+        StatEntry, // one stat of a directory entry
+        ModelData, // FileModel::data() call
+        FileInfoRead, // FileInfo::readFile() call
+        CopyBytes, // value is the bytes copied
+        DeleteEntry, // one deleted file or directory
+        GuiStall, // the gui thread was late by the duration
+        ProbeCount
+    };
+
+    static PerfTrace *instance(); // call only in the gui thread
+    ~PerfTrace();
+
+    static bool isAvailable(); // false if compiled out
+    static inline bool isEnabled() { return s_enabled.loadAcquire() != 0; }
+    void setEnabled(bool enabled);
+
+    // rates and averages of the latest seconds, only "available" and "enabled" if not tracing
+    QVariantMap stats() const { return m_stats; }
+
+    static void record(Probe probe, qint64 nsecs, qint64 value);
+
+signals:
+    void statsChanged();
+
+private slots:
+    void takeSample();
+    void checkStall();
+
+private:
+    struct Totals {
+        Totals();
+        qint64 count[ProbeCount];
+        qint64 nsecs[ProbeCount];
+        qint64 maxNsecs[ProbeCount];
+        qint64 value[ProbeCount];
+    };
+
+    explicit PerfTrace(QObject *parent = 0);
+    void updateStats();
+
+    static QAtomicInt s_enabled;
+    static Totals s_current; // totals since the last sample, protected by a mutex
+    QTimer *m_sampleTimer;
+    QTimer *m_stallTimer;
+    QElapsedTimer m_stallClock;
+    QVector<Totals> m_samples; // ring buffer of one second samples
+    int m_nextSample;
+    int m_sampleCount;
+    QVariantMap m_stats;
+};
+
+/**
+ * @brief PerfScope records the time from its construction to its destruction.
+ */
+class PerfScope
+{
+public:
+    explicit PerfScope(PerfTrace::Probe probe) : m_probe(probe), m_enabled(PerfTrace::isEnabled()), m_value(0)
+    {
+        if (m_enabled)
+            m_timer.start();
+    }
+    ~PerfScope()
+    {
+        if (m_enabled)
+            PerfTrace::record(m_probe, m_timer.nsecsElapsed(), m_value);
+    }
+    void setValue(qint64 value) { m_value = value; }
+
+private:
+    PerfTrace::Probe m_probe;
+    bool m_enabled;
+    qint64 m_value;
+    QElapsedTimer m_timer;
+};
+
+#ifdef PERF_TRACE
+#define PERF_SCOPE(probe) PerfScope perfScope(PerfTrace::probe)
+#define PERF_SCOPE_VALUE(value) perfScope.setValue(value)
+#define PERF_COUNT(probe, value) \
+    do { if (PerfTrace::isEnabled()) PerfTrace::record(PerfTrace::probe, 0, value); } while (0)
+#else
+#define PERF_SCOPE(probe)
+#define PERF_SCOPE_VALUE(value)
+#define PERF_COUNT(probe, value)
+#endif
+
+#endif // PERFTRACE_H
@@ -4,6 +4,24 @@ import "pages"
 
 ApplicationWindow
 {
+    // pages not needed for the first frame are compiled in the background after it,
+    // so pushing them later finds them in the component cache
+    property var preloadedPages: []
+
+    Timer {
+        interval: 500
+        running: true
+        onTriggered: {
+            var pages = [ "FilePage.qml", "ConsolePage.qml", "AboutPage.qml" ];
+            var components = [];
+            for (var i = 0; i < pages.length; ++i) {
+                components.push(Qt.createComponent(Qt.resolvedUrl("pages/"+pages[i]),
+                                                   Component.Asynchronous));
+            }
+            preloadedPages = components; // kept, so the compiled pages stay in the cache
+        }
+    }
+
     initialPage: Component {
         DirectoryPage {
             initial: true
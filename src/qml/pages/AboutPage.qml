@@ -30,6 +30,12 @@ Page {
                 anchors.topMargin: 6
                 anchors.horizontalCenter: parent.horizontalCenter
                 source: "../images/harbour-file-browser.png"
+
+                // hidden entry to the performance statistics
+                MouseArea {
+                    anchors.fill: parent
+                    onPressAndHold: pageStack.push(Qt.resolvedUrl("DebugPage.qml"))
+                }
             }
             Item { // used for spacing
                 width: parent.width
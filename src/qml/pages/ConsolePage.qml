@@ -13,6 +13,11 @@ Page {
     property string infoText: ""
     property color consoleColor: Theme.secondaryColor
 
+    // the header items are created by the list view, so they are bound to these
+    property bool running: true
+    property string statusText: initialText
+    property string shownInfoText: ""
+
     // execute command when page activates
     onStatusChanged: {
         if (status === PageStatus.Activating) {
@@ -25,43 +30,43 @@ Page {
 
         // called when command exits
         onProcessExited: {
-            busyIndicator.running = false;
+            page.running = false;
             if (exitCode == 0) {
-                statusLabel.text = page.successText;
-                infoLabel.text = page.infoText;
+                page.statusText = page.successText;
+                page.shownInfoText = page.infoText;
             } else {
-                statusLabel.text = "Failed! Error code: "+exitCode;
+                page.statusText = "Failed! Error code: "+exitCode;
             }
         }
     }
 
-    SilicaFlickable {
-        id: flickable
+    // output lines are rows, so new output only adds delegates instead of relayouting all text
+    SilicaListView {
+        id: outputList
         anchors.fill: parent
-        contentHeight: column.height
-        VerticalScrollDecorator { flickable: flickable }
+        model: fileInfo.processOutput
+        VerticalScrollDecorator { flickable: outputList }
 
-        Column {
-            id: column
-            width: parent.width
+        header: Column {
+            width: outputList.width
 
             PageHeader { title: page.title }
 
             BusyIndicator {
                 id: busyIndicator
                 anchors.horizontalCenter: parent.horizontalCenter
-                running: true
+                running: page.running
                 size: BusyIndicatorSize.Small
             }
             Label {
                 id: statusLabel
                 anchors.horizontalCenter: parent.horizontalCenter
-                text: page.initialText
+                text: page.statusText
             }
             Label {
                 id: infoLabel
                 visible: text !== ""
-                text: ""
+                text: page.shownInfoText
                 anchors.left: parent.left
                 anchors.right: parent.right
                 anchors.leftMargin: Theme.paddingLarge
@@ -83,18 +88,24 @@ Page {
                 font.family: "Monospace"
                 color: Theme.secondaryColor
             }
-
-            // command output
             Label {
                 width: parent.width
-                text: fileInfo.processOutput
-                wrapMode: Text.WrapAnywhere
+                visible: fileInfo.processOutput.truncated
+                text: "..."
                 font.pixelSize: Theme.fontSizeTiny
                 font.family: "Monospace"
-                color: page.consoleColor
+                color: Theme.secondaryColor
             }
         }
+
+        // command output
+        delegate: Label {
+            width: outputList.width
+            text: line
+            wrapMode: Text.WrapAnywhere
+            font.pixelSize: Theme.fontSizeTiny
+            font.family: "Monospace"
+            color: page.consoleColor
+        }
     }
 }
-
-
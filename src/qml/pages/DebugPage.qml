@@ -0,0 +1,96 @@
+import QtQuick 2.0
+import Sailfish.Silica 1.0
+
+Page {
+    id: page
+    allowedOrientations: Orientation.All
+
+    property var stats: engine.perfStats
+
+    // tracing runs only while this page is shown
+    onStatusChanged: {
+        if (status === PageStatus.Activating)
+            engine.perfTracing = true;
+        else if (status === PageStatus.Deactivating)
+            engine.perfTracing = false;
+    }
+    Component.onDestruction: engine.perfTracing = false
+
+    function format(value, decimals) {
+        return value !== undefined ? Number(value).toFixed(decimals) : "-";
+    }
+
+    SilicaFlickable {
+        id: flickable
+        anchors.fill: parent
+        contentHeight: column.height
+
+        VerticalScrollDecorator { flickable: flickable }
+
+        Column {
+            id: column
+            anchors.left: parent.left
+            anchors.right: parent.right
+            anchors.leftMargin: Theme.paddingLarge
+            anchors.rightMargin: Theme.paddingLarge
+
+            PageHeader { title: "Performance" }
+
+            Label {
+                width: parent.width
+                visible: !stats.available
+                text: "Tracing is not compiled in. Build with CONFIG+=perftrace."
+                wrapMode: Text.Wrap
+                color: Theme.highlightColor
+            }
+            Label {
+                width: parent.width
+                visible: stats.available
+                text: stats.seconds !== undefined ?
+                          "Last "+format(stats.seconds, 0)+" seconds" : "Collecting..."
+                font.pixelSize: Theme.fontSizeExtraSmall
+                color: Theme.secondaryColor
+            }
+            Item { // used for spacing
+                width: parent.width
+                height: 20
+            }
+
+            Repeater {
+                model: stats.available ? [
+                    { name: "Directory scans", value: format(stats.scans, 0) },
+                    { name: "Scan time", value: format(stats.scanMs, 1)+" ms" },
+                    { name: "Longest scan", value: format(stats.scanMaxMs, 1)+" ms" },
+                    { name: "Entries per scan", value: format(stats.entriesPerScan, 0) },
+                    { name: "Stats", value: format(stats.statsPerSecond, 0)+" /s" },
+                    { name: "Model data calls", value: format(stats.dataCallsPerSecond, 0)+" /s" },
+                    { name: "Model data time", value: format(stats.dataNsAvg, 0)+" ns" },
+                    { name: "File info reads", value: format(stats.fileInfoReads, 0) },
+                    { name: "File info time", value: format(stats.fileInfoMs, 1)+" ms" },
+                    { name: "Copy speed", value: format(stats.copyMBps, 1)+" MB/s" },
+                    { name: "Deletes", value: format(stats.deletesPerSecond, 0)+" /s" },
+                    { name: "GUI stalls", value: format(stats.guiStalls, 0) },
+                    { name: "GUI stall time", value: format(stats.guiStallMs, 0)+" ms" },
+                    { name: "Longest stall (1 min)", value: format(stats.guiStallMaxMs, 0)+" ms" }
+                ] : []
+
+                Row {
+                    width: column.width
+                    spacing: 10
+                    Label {
+                        text: modelData.name
+                        color: Theme.secondaryColor
+                        width: parent.width/2
+                        horizontalAlignment: Text.AlignRight
+                        font.pixelSize: Theme.fontSizeExtraSmall
+                    }
+                    Label {
+                        text: modelData.value
+                        width: parent.width/2
+                        font.pixelSize: Theme.fontSizeExtraSmall
+                    }
+                }
+            }
+        }
+    }
+}
@@ -8,6 +8,7 @@ Page {
     allowedOrientations: Orientation.All
     property string dir: "/"
     property bool initial: false // this is set to true if the page is initial page
+    property bool filterVisible: false
 
     FileModel {
         id: fileModel
@@ -47,6 +48,30 @@ Page {
                 text: "Go to Home"
                 onClicked: Functions.goToHome(StandardPaths.documents, page.dir)
             }
+            MenuItem {
+                text: "Search"
+                onClicked: pageStack.push(Qt.resolvedUrl("SearchPage.qml"), { dir: page.dir })
+            }
+            MenuItem {
+                text: "Sort by " + Functions.sortByName(fileModel.sortBy)
+                onClicked: fileModel.sortBy = Functions.nextSortBy(fileModel.sortBy)
+            }
+            MenuItem {
+                text: page.filterVisible ? "Hide Filter" : "Filter"
+                onClicked: {
+                    page.filterVisible = !page.filterVisible;
+                    if (!page.filterVisible)
+                        fileModel.nameFilter = "";
+                }
+            }
+            MenuItem {
+                text: engine.verifyCopies ? "Don't Verify Copies" : "Verify Copies"
+                onClicked: engine.verifyCopies = !engine.verifyCopies
+            }
+            MenuItem {
+                text: engine.skipUnchanged ? "Copy All Files" : "Copy Only Changed Files"
+                onClicked: engine.skipUnchanged = !engine.skipUnchanged
+            }
             MenuItem {
                 text: "Paste" + (engine.clipboardCount > 0 ? " ("+engine.clipboardCount+")" : "")
                 onClicked: {
@@ -56,7 +81,18 @@ Page {
             }
         }
 
-        header: PageHeader { title: Functions.formatPathForTitle(page.dir) }
+        header: Column {
+            width: parent.width
+            PageHeader { title: Functions.formatPathForTitle(page.dir) }
+            // filters the list while typing, no need to read the directory again
+            SearchField {
+                width: parent.width
+                visible: page.filterVisible
+                placeholderText: "Filter"
+                text: fileModel.nameFilter
+                onTextChanged: fileModel.nameFilter = text
+            }
+        }
 
         delegate: ListItem {
             id: fileItem
@@ -70,7 +106,20 @@ Page {
                 anchors.top: parent.top
                 anchors.topMargin: 9
                 source: "../images/small-"+fileIcon+".png"
+                visible: listThumbnail.status !== Image.Ready
             }
+            Image {
+                id: listThumbnail
+                anchors.fill: listIcon
+                source: thumbnail
+                sourceSize.width: width
+                sourceSize.height: height
+                fillMode: Image.PreserveAspectCrop
+                clip: true
+                asynchronous: true
+                visible: status === Image.Ready
+            }
+            Component.onDestruction: fileModel.cancelThumbnail(filename)
             Label {
                 id: listLabel
                 anchors.left: listIcon.right
@@ -150,7 +199,13 @@ Page {
     Label {
         anchors.centerIn: parent
         text: "No files"
-        visible: fileModel.fileCount === 0 && fileModel.errorMessage === ""
+        visible: fileModel.fileCount === 0 && fileModel.errorMessage === "" && !fileModel.loading
+    }
+    BusyIndicator {
+        anchors.centerIn: parent
+        size: BusyIndicatorSize.Large
+        // only shown if nothing has been read yet, later entries just stream in
+        running: fileModel.loading && fileModel.fileCount === 0
     }
     Label {
         anchors.centerIn: parent
@@ -163,10 +218,13 @@ Page {
         if (status === PageStatus.Activating) {
             coverPlaceholder.text = "File Browser\n"+Functions.formatPathForCover(page.dir)+"/";
 
-            // go to Home on startup
+            // go to the directory shown last or Home on startup
             if (page.initial) {
                 page.initial = false;
-                Functions.goToHome(StandardPaths.documents);
+                if (startDir === "")
+                    Functions.goToHome(StandardPaths.documents);
+                else if (startDir !== "/")
+                    Functions.goToFolder(startDir);
             }
         }
     }
@@ -292,9 +350,7 @@ Page {
                 // the error signal goes to all pages in pagestack, show it only in the active one
                 if (progressPanel.open) {
                     progressPanel.hide();
-                    if (message === "Unknown error")
-                        filename = "Trying to move between phone and SD Card? It doesn't work, try copying.";
-                    else if (message === "Failure to write block")
+                    if (storageFull)
                         filename = "Perhaps the storage is full?";
 
                     notificationPanel.showWithText(message, filename);
@@ -312,6 +368,11 @@ Page {
             color: "black"
             opacity: 0.7
         }
+        // tapping the panel hides it, the jobs continue in the background
+        MouseArea {
+            anchors.fill: parent
+            onClicked: progressPanel.hide()
+        }
         BusyIndicator {
             id: progressBusy
             anchors.right: progressHeader.left
@@ -363,6 +424,17 @@ Page {
             font.pixelSize: Theme.fontSizeTiny
             color: Theme.primaryColor
         }
+        Label {
+            visible: progressPanel.open && engine.bytesTotal > 0
+            anchors.left: progressHeader.left
+            anchors.right: cancelButton.left
+            anchors.rightMargin: Theme.paddingLarge
+            anchors.top: progressText.bottom
+            text: engine.progress+"% "+Functions.formatTransfer(engine.bytesPerSecond,
+                                                                engine.secondsLeft)
+            font.pixelSize: Theme.fontSizeTiny
+            color: Theme.secondaryColor
+        }
     }
 }
 
@@ -87,6 +87,12 @@ Page {
                 visible: fileInfo.suffix !== "apk" && fileInfo.suffix !== "rpm" && fileInfo.suffix !== "mp3" // && fileInfo.suffix !== "mp4"
                 onClicked: fileInfo.executeCommand("xdg-open", [ page.file ])
             }
+            MenuItem {
+                text: "Compute Checksum"
+                visible: fileInfo.kind === "-"
+                enabled: fileInfo.checksumProgress < 0
+                onClicked: fileInfo.computeChecksum()
+            }
             MenuItem {
                 text: "Play " + (fileInfo.suffix == "mp3" ? "Music" : "Video")
                 visible: fileInfo.suffix == "mp3" || fileInfo.suffix == "mp4"
@@ -189,7 +195,26 @@ Page {
                         font.pixelSize: Theme.fontSizeExtraSmall
                     }
                     Label {
-                        text: fileInfo.size
+                        text: fileInfo.kind === "d" ? fileInfo.dirSize : fileInfo.size
+                        font.pixelSize: Theme.fontSizeExtraSmall
+                    }
+                }
+                Row {
+                    width: parent.width
+                    spacing: 10
+                    visible: fileInfo.checksum !== "" || fileInfo.checksumProgress >= 0
+                    Label {
+                        text: "CRC-32C"
+                        color: Theme.secondaryColor
+                        width: parent.width/2
+                        horizontalAlignment: Text.AlignRight
+                        font.pixelSize: Theme.fontSizeExtraSmall
+                    }
+                    Label {
+                        text: fileInfo.checksumProgress >= 0 ?
+                                  "Calculating "+fileInfo.checksumProgress+"%" : fileInfo.checksum
+                        wrapMode: Text.Wrap
+                        width: parent.width/2
                         font.pixelSize: Theme.fontSizeExtraSmall
                     }
                 }
@@ -0,0 +1,101 @@
+import QtQuick 2.0
+import Sailfish.Silica 1.0
+import harbour.file.browser.SearchModel 1.0
+import "functions.js" as Functions
+
+Page {
+    id: page
+    allowedOrientations: Orientation.All
+    property string dir: "/"
+
+    SearchModel {
+        id: searchModel
+        dir: page.dir
+    }
+
+    SilicaListView {
+        id: resultList
+        anchors.fill: parent
+
+        model: searchModel
+
+        VerticalScrollDecorator { flickable: resultList }
+
+        PullDownMenu {
+            MenuItem {
+                text: engine.indexEnabled ? "Disable Search Index" : "Enable Search Index"
+                onClicked: engine.indexEnabled = !engine.indexEnabled
+            }
+        }
+
+        header: Column {
+            width: parent.width
+            PageHeader { title: "Search in " + Functions.formatPathForTitle(page.dir) }
+            // results stream in while typing, a new text cancels the running search
+            SearchField {
+                id: searchField
+                width: parent.width
+                placeholderText: "Search"
+                text: searchModel.searchText
+                onTextChanged: searchModel.searchText = text
+                Component.onCompleted: searchField.forceActiveFocus()
+            }
+        }
+
+        delegate: ListItem {
+            id: resultItem
+            width: ListView.view.width
+
+            Image {
+                id: listIcon
+                anchors.left: parent.left
+                anchors.leftMargin: Theme.paddingLarge
+                anchors.top: parent.top
+                anchors.topMargin: 9
+                source: "../images/small-"+fileIcon+".png"
+            }
+            Label {
+                id: listLabel
+                anchors.left: listIcon.right
+                anchors.leftMargin: 10
+                anchors.right: parent.right
+                anchors.rightMargin: Theme.paddingLarge
+                anchors.top: parent.top
+                anchors.topMargin: 3
+                text: filename
+                elide: Text.ElideRight
+            }
+            Label {
+                anchors.left: listIcon.right
+                anchors.leftMargin: 10
+                anchors.right: parent.right
+                anchors.rightMargin: Theme.paddingLarge
+                anchors.top: listLabel.bottom
+                text: dir
+                color: Theme.secondaryColor
+                font.pixelSize: Theme.fontSizeExtraSmall
+                elide: Text.ElideMiddle
+            }
+
+            onClicked: {
+                if (filekind === "d")
+                    pageStack.push(Qt.resolvedUrl("DirectoryPage.qml"), { dir: path });
+                else
+                    pageStack.push(Qt.resolvedUrl("FilePage.qml"), { file: path });
+            }
+        }
+    }
+    Label {
+        anchors.centerIn: parent
+        text: "No files found"
+        visible: searchModel.resultCount === 0 && searchModel.searchText !== "" &&
+                 !searchModel.searching
+    }
+    BusyIndicator {
+        anchors.bottom: parent.bottom
+        anchors.bottomMargin: Theme.paddingLarge
+        anchors.horizontalCenter: parent.horizontalCenter
+        size: BusyIndicatorSize.Medium
+        running: searchModel.searching
+    }
+}
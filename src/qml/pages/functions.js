@@ -100,3 +100,32 @@ function formatPathForCover(path)
 
     return path.substring(i+1);
 }
+
+// sort orders in the same order as FileModel.SortBy
+var sortByNames = [ "Name", "Size", "Date", "Type" ];
+
+function sortByName(sortBy)
+{
+    return sortByNames[sortBy];
+}
+
+function nextSortBy(sortBy)
+{
+    return (sortBy + 1) % sortByNames.length;
+}
+
+// formats transfer rate and time left, like "1.50 MB/s, 2:05 left"
+function formatTransfer(bytesPerSecond, secondsLeft)
+{
+    if (bytesPerSecond <= 0)
+        return "";
+
+    var rate = bytesPerSecond < 1000000 ? (bytesPerSecond/1000).toFixed(0)+" kB/s"
+                                         : (bytesPerSecond/1000000).toFixed(2)+" MB/s";
+    if (secondsLeft < 0)
+        return rate;
+
+    var minutes = Math.floor(secondsLeft / 60);
+    var seconds = secondsLeft % 60;
+    return rate+", "+minutes+":"+(seconds < 10 ? "0" : "")+seconds+" left";
+}
@@ -0,0 +1,209 @@
+#include "searchmodel.h"
+#include "globals.h"
+
+enum {
+    FilenameRole = Qt::UserRole + 1,
+    FileKindRole = Qt::UserRole + 2,
+    FileIconRole = Qt::UserRole + 3,
+    PathRole = Qt::UserRole + 4,
+    DirRole = Qt::UserRole + 5
+};
+
+// delay after the last change of the search text (milliseconds)
+static const int SearchDelay = 300;
+
+SearchModel::SearchModel(QObject *parent) :
+    QAbstractListModel(parent),
+    m_searching(false),
+    m_generation(0)
+{
+    m_searchTimer = new QTimer(this);
+    m_searchTimer->setSingleShot(true);
+    m_searchTimer->setInterval(SearchDelay);
+    connect(m_searchTimer, SIGNAL(timeout()), this, SLOT(startSearch()));
+
+    m_searchWorker = new SearchWorker;
+    connect(m_searchWorker, SIGNAL(resultsFound(int, SearchResultList)),
+            this, SLOT(appendResults(int, SearchResultList)));
+    connect(m_searchWorker, SIGNAL(done(int, QString)), this, SLOT(searchDone(int, QString)));
+}
+
+SearchModel::~SearchModel()
+{
+    m_searchWorker->cancel(); // stop possibly running search
+    m_searchWorker->wait();
+    delete m_searchWorker;
+}
+
+int SearchModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return m_results.count();
+}
+
+QVariant SearchModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() > m_results.size()-1)
+        return QVariant();
+
+    const SearchResult &result = m_results.at(index.row());
+    switch (role) {
+
+    case Qt::DisplayRole:
+    case FilenameRole:
+        return result.data.name;
+
+    case FileKindRole:
+        return fileKindToString(result.data.kind);
+
+    case FileIconRole:
+        return iconIdToName(result.data.icon);
+
+    case PathRole:
+        return result.dir + "/" + result.data.name;
+
+    case DirRole:
+        return result.dir.isEmpty() ? QString("/") : result.dir;
+
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> SearchModel::roleNames() const
+{
+    QHash<int, QByteArray> roles = QAbstractListModel::roleNames();
+    roles.insert(FilenameRole, QByteArray("filename"));
+    roles.insert(FileKindRole, QByteArray("filekind"));
+    roles.insert(FileIconRole, QByteArray("fileIcon"));
+    roles.insert(PathRole, QByteArray("path"));
+    roles.insert(DirRole, QByteArray("dir"));
+    return roles;
+}
+
+void SearchModel::setDir(QString dir)
+{
+    if (m_dir == dir)
+        return;
+
+    m_dir = dir;
+    m_completedText.clear();
+    emit dirChanged();
+    m_searchTimer->start();
+}
+
+void SearchModel::setSearchText(QString searchText)
+{
+    if (m_searchText == searchText)
+        return;
+
+    m_searchText = searchText;
+    emit searchTextChanged();
+
+    // a longer text only matches a subset, so the completed results can just be filtered
+    if (!m_completedText.isEmpty() && searchText.contains(m_completedText, Qt::CaseInsensitive)) {
+        m_searchTimer->stop();
+
+        // runs of removed rows are removed together, from the end so indexes stay valid
+        int last = m_results.count() - 1;
+        while (last >= 0) {
+            if (m_results.at(last).data.name.contains(searchText, Qt::CaseInsensitive)) {
+                --last;
+                continue;
+            }
+            int first = last;
+            while (first > 0 &&
+                   !m_results.at(first - 1).data.name.contains(searchText, Qt::CaseInsensitive))
+                --first;
+
+            beginRemoveRows(QModelIndex(), first, last);
+            m_results.erase(m_results.begin() + first, m_results.begin() + last + 1);
+            endRemoveRows();
+            last = first - 1;
+        }
+        m_completedText = searchText;
+        emit resultCountChanged();
+        return;
+    }
+
+    m_searchTimer->start();
+}
+
+QString SearchModel::filePathAt(int index)
+{
+    if (index < 0 || index >= m_results.count())
+        return QString();
+
+    const SearchResult &result = m_results.at(index);
+    return result.dir + "/" + result.data.name;
+}
+
+void SearchModel::cancel()
+{
+    m_searchTimer->stop();
+    ++m_generation;
+    m_searchWorker->cancel();
+    setSearching(false);
+}
+
+void SearchModel::startSearch()
+{
+    clearResults();
+    m_completedText.clear();
+    m_errorMessage = "";
+    emit errorMessageChanged();
+
+    // results of a possibly running search are discarded when they arrive
+    ++m_generation;
+    if (m_dir.isEmpty() || m_searchText.isEmpty()) {
+        m_searchWorker->cancel();
+        setSearching(false);
+        return;
+    }
+
+    setSearching(true);
+    m_searchWorker->startSearch(m_dir, m_searchText, m_generation);
+}
+
+void SearchModel::appendResults(int generation, SearchResultList results)
+{
+    if (generation != m_generation || results.isEmpty())
+        return;
+
+    beginInsertRows(QModelIndex(), m_results.count(), m_results.count() + results.count() - 1);
+    m_results.append(results);
+    endInsertRows();
+    emit resultCountChanged();
+}
+
+void SearchModel::searchDone(int generation, QString errorMessage)
+{
+    if (generation != m_generation)
+        return;
+
+    if (errorMessage.isEmpty())
+        m_completedText = m_searchText;
+    m_errorMessage = errorMessage;
+    setSearching(false);
+    emit errorMessageChanged();
+}
+
+void SearchModel::setSearching(bool searching)
+{
+    if (m_searching == searching)
+        return;
+
+    m_searching = searching;
+    emit searchingChanged();
+}
+
+void SearchModel::clearResults()
+{
+    if (m_results.isEmpty())
+        return;
+
+    beginResetModel();
+    m_results.clear();
+    endResetModel();
+    emit resultCountChanged();
+}
@@ -0,0 +1,74 @@
+#ifndef SEARCHMODEL_H
+#define SEARCHMODEL_H
+
+#include <QAbstractListModel>
+#include <QTimer>
+#include "searchworker.h"
+
+/**
+ * @brief The SearchModel class lists the files under a directory whose names contain a text.
+ * The search runs in a background thread and results are added to the model as they are
+ * found. Changing the text restarts the search after a short delay, so typing does not start
+ * a search for every character. If the previous search has completed and the new text
+ * contains the old one, the current results are just filtered.
+ * If the FileIndex is enabled and up to date for the directory, the worker searches it instead.
+ */
+class SearchModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QString dir READ dir() WRITE setDir(QString) NOTIFY dirChanged())
+    Q_PROPERTY(QString searchText READ searchText() WRITE setSearchText(QString) NOTIFY searchTextChanged())
+    Q_PROPERTY(int resultCount READ resultCount() NOTIFY resultCountChanged())
+    Q_PROPERTY(bool searching READ searching() NOTIFY searchingChanged())
+    Q_PROPERTY(QString errorMessage READ errorMessage() NOTIFY errorMessageChanged())
+
+public:
+    explicit SearchModel(QObject *parent = 0);
+    ~SearchModel();
+
+    // methods needed by ListView
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QHash<int, QByteArray> roleNames() const;
+
+    // property accessors
+    QString dir() const { return m_dir; }
+    void setDir(QString dir);
+    QString searchText() const { return m_searchText; }
+    void setSearchText(QString searchText);
+    int resultCount() const { return m_results.count(); }
+    bool searching() const { return m_searching; }
+    QString errorMessage() const { return m_errorMessage; }
+
+    // methods accessible from QML
+    Q_INVOKABLE QString filePathAt(int index);
+    Q_INVOKABLE void cancel();
+
+signals:
+    void dirChanged();
+    void searchTextChanged();
+    void resultCountChanged();
+    void searchingChanged();
+    void errorMessageChanged();
+
+private slots:
+    void startSearch();
+    void appendResults(int generation, SearchResultList results);
+    void searchDone(int generation, QString errorMessage);
+
+private:
+    void setSearching(bool searching);
+    void clearResults();
+
+    QString m_dir;
+    QString m_searchText;
+    QString m_completedText; // text of the last completed search, empty if none
+    SearchResultList m_results;
+    QString m_errorMessage;
+    bool m_searching;
+    int m_generation; // incremented for each search, used to discard results of stale ones
+    QTimer *m_searchTimer;
+    SearchWorker *m_searchWorker;
+};
+
+#endif // SEARCHMODEL_H
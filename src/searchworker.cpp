@@ -0,0 +1,225 @@
+#include "searchworker.h"
+#include "fileindex.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+// results are sent when the batch is full or this many milliseconds have passed
+static const int FirstBatchSize = 64;
+static const int MaxBatchSize = 1024;
+static const int SendInterval = 100;
+
+// file system magic numbers of the pseudo file systems which are not searched
+static const long ProcSuperMagic = 0x9fa0;
+static const long SysfsMagic = 0x62656572;
+static const long DevptsSuperMagic = 0x1cd1;
+static const long DebugfsMagic = 0x64626720;
+static const long CgroupSuperMagic = 0x27e0eb;
+static const long Cgroup2SuperMagic = 0x63677270;
+static const long SecurityfsMagic = 0x73636673;
+
+static bool isPseudoFileSystem(int dirFd)
+{
+    struct statfs fs;
+    if (fstatfs(dirFd, &fs) != 0)
+        return false;
+
+    long type = (long)fs.f_type;
+    return type == ProcSuperMagic || type == SysfsMagic || type == DevptsSuperMagic ||
+            type == DebugfsMagic || type == CgroupSuperMagic || type == Cgroup2SuperMagic ||
+            type == SecurityfsMagic;
+}
+
+SearchWorker::SearchWorker(QObject *parent) :
+    QThread(parent),
+    m_generation(0),
+    m_pending(false),
+    m_running(false),
+    m_latestGeneration(0),
+    m_searchGeneration(0),
+    m_batchSize(FirstBatchSize)
+{
+    qRegisterMetaType<SearchResultList>("SearchResultList");
+}
+
+SearchWorker::~SearchWorker()
+{
+}
+
+void SearchWorker::startSearch(QString dir, QString text, int generation)
+{
+    bool needStart = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_dir = dir;
+        m_text = text;
+        m_generation = generation;
+        m_pending = true;
+        m_latestGeneration.storeRelease(generation);
+        if (!m_running) {
+            m_running = true;
+            needStart = true;
+        }
+    }
+
+    if (needStart) {
+        wait(); // the thread may still be returning from a previous run
+        start(QThread::LowPriority);
+    }
+}
+
+void SearchWorker::cancel()
+{
+    // no search has a negative generation, so the running one becomes stale
+    m_latestGeneration.storeRelease(-1);
+}
+
+void SearchWorker::run() Q_DECL_OVERRIDE
+{
+    forever {
+        QString dir;
+        QString text;
+        int generation;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_pending) {
+                m_running = false;
+                return;
+            }
+            dir = m_dir;
+            text = m_text;
+            generation = m_generation;
+            m_pending = false;
+        }
+
+        QString errorMessage = search(dir, text, generation);
+        if (!isStale(generation))
+            emit done(generation, errorMessage);
+    }
+}
+
+QString SearchWorker::search(QString dir, QString text, int generation)
+{
+    int dirFd = open(QFile::encodeName(dir).constData(), O_RDONLY | O_DIRECTORY);
+    if (dirFd < 0)
+        return tr("Directory does not exist");
+
+    struct stat st;
+    if (fstat(dirFd, &st) != 0) {
+        close(dirFd);
+        return tr("Directory does not exist");
+    }
+
+    m_searchText = text;
+    m_searchGeneration = generation;
+    m_results.clear();
+    m_batchSize = FirstBatchSize;
+    m_sendTimer.start();
+
+    // the index answers without reading the directories if nothing under dir has changed
+    if (FileIndex::instance()->search(dir, text, this)) {
+        close(dirFd);
+    } else {
+        // the fd is closed by the walk
+        QString dirPath = dir.endsWith('/') ? dir.left(dir.length() - 1) : dir;
+        searchDirectory(dirFd, dirPath, st.st_dev, generation);
+    }
+    if (!isStale(generation))
+        sendResults(generation, true);
+    m_results.clear();
+    return QString();
+}
+
+void SearchWorker::searchDirectory(int dirFd, const QString &dirPath, quint64 device,
+                                   int generation)
+{
+    DIR *dir = fdopendir(dirFd);
+    if (!dir) {
+        close(dirFd);
+        return; // unreadable directories are skipped
+    }
+
+    // names are collected first, so only one fd per directory level is open while descending
+    QList<QByteArray> subdirs;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != 0) {
+        if (isStale(generation))
+            break;
+
+        // hidden files are not shown in the listings either
+        if (ent->d_name[0] == '.')
+            continue;
+
+        unsigned char type = ent->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+        }
+        if (type == DT_DIR)
+            subdirs.append(QByteArray(ent->d_name));
+
+        QString name = QFile::decodeName(ent->d_name);
+        if (!name.contains(m_searchText, Qt::CaseInsensitive))
+            continue;
+
+        SearchResult result;
+        result.dir = dirPath;
+        result.data.name = name;
+        result.data.setKind(type == DT_DIR ? S_IFDIR : S_IFREG, type == DT_LNK);
+        m_results.append(result);
+        sendResults(generation, false);
+    }
+
+    foreach (const QByteArray &name, subdirs) {
+        if (isStale(generation))
+            break;
+
+        int fd = openat(dirfd(dir), name.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+        if (fd < 0)
+            continue;
+
+        // mount points are checked for pseudo file systems
+        struct stat st;
+        if (fstat(fd, &st) != 0 || ((quint64)st.st_dev != device && isPseudoFileSystem(fd))) {
+            close(fd);
+            continue;
+        }
+        searchDirectory(fd, dirPath + '/' + QFile::decodeName(name), st.st_dev, generation);
+    }
+    closedir(dir);
+}
+
+void SearchWorker::sendResults(int generation, bool force)
+{
+    if (m_results.isEmpty())
+        return;
+    if (!force && m_results.count() < m_batchSize && m_sendTimer.elapsed() < SendInterval)
+        return;
+
+    emit resultsFound(generation, m_results);
+    m_results.clear();
+    m_batchSize = qMin(m_batchSize * 2, MaxBatchSize);
+    m_sendTimer.restart();
+}
+
+bool SearchWorker::addResult(const SearchResult &result)
+{
+    if (isStale(m_searchGeneration))
+        return false;
+
+    m_results.append(result);
+    sendResults(m_searchGeneration, false);
+    return true;
+}
+
+bool SearchWorker::isStale(int generation) const
+{
+    return m_latestGeneration.loadAcquire() != generation;
+}
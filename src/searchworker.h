@@ -0,0 +1,86 @@
+#ifndef SEARCHWORKER_H
+#define SEARCHWORKER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QElapsedTimer>
+#include "filedata.h"
+
+// one found file, dir is the directory it is in
+struct SearchResult
+{
+    QString dir;
+    FileData data;
+};
+
+typedef QList<SearchResult> SearchResultList;
+
+Q_DECLARE_METATYPE(SearchResultList)
+
+/**
+ * @brief SearchResultHandler receives search results one at a time, see FileIndex::search().
+ */
+class SearchResultHandler
+{
+public:
+    virtual ~SearchResultHandler() {}
+    // returns false to stop the search
+    virtual bool addResult(const SearchResult &result) = 0;
+};
+
+/**
+ * @brief SearchWorker searches files by name under a directory in the background.
+ * Directories are walked with readdir() relative to directory fds and the kinds come from
+ * d_type, so files are not stat-ed. Links are not followed, and pseudo file systems like
+ * /proc and /sys are skipped. Results are sent in batches with the generation number of the
+ * search, a new search makes the running one stale, so it stops early.
+ * The FileIndex is searched first in the worker thread, the directories are walked only
+ * if the index can't answer.
+ */
+class SearchWorker : public QThread, private SearchResultHandler
+{
+    Q_OBJECT
+
+public:
+    explicit SearchWorker(QObject *parent = 0);
+    ~SearchWorker();
+
+    // starts searching names containing the text (case insensitive), a running search is stopped
+    void startSearch(QString dir, QString text, int generation);
+    void cancel();
+
+signals: // signals, can be connected from a thread to another
+    void resultsFound(int generation, SearchResultList results);
+
+    // emitted when the search has ended, error message is empty if ok
+    void done(int generation, QString errorMessage);
+
+protected:
+    void run();
+
+private:
+    QString search(QString dir, QString text, int generation);
+    void searchDirectory(int dirFd, const QString &dirPath, quint64 device, int generation);
+    void sendResults(int generation, bool force);
+    bool addResult(const SearchResult &result);
+    bool isStale(int generation) const;
+
+    QMutex m_mutex; // protects the request members below
+    QString m_dir;
+    QString m_text;
+    int m_generation;
+    bool m_pending;
+    bool m_running;
+
+    // atomic so no locks needed to check for stale requests
+    QAtomicInt m_latestGeneration;
+
+    // state of the running search, used only in the worker thread
+    QString m_searchText;
+    int m_searchGeneration;
+    SearchResultList m_results;
+    int m_batchSize;
+    QElapsedTimer m_sendTimer;
+};
+
+#endif // SEARCHWORKER_H
@@ -29,8 +29,21 @@ icon.path = /usr/share/icons/hicolor/86x86/apps
 INSTALLS += target icon desktop  qml
 # End of Nov 2013 fix
 
-SOURCES += main.cpp filemodel.cpp fileinfo.cpp engine.cpp fileworker.cpp globals.cpp
-HEADERS += filemodel.h fileinfo.h engine.h fileworker.h globals.h
+# tracing of the hot paths for the debug page, opt-in with "qmake CONFIG+=perftrace"
+CONFIG(perftrace): DEFINES += PERF_TRACE
+
+SOURCES += main.cpp filemodel.cpp fileinfo.cpp engine.cpp fileworker.cpp globals.cpp \
+    filedata.cpp dirworker.cpp copyqueue.cpp dirsizeservice.cpp \
+    metadatacache.cpp thumbnailservice.cpp thumbnailprovider.cpp \
+    searchworker.cpp searchmodel.cpp fileindex.cpp consolemodel.cpp \
+    commandrunner.cpp crc32c.cpp checksumworker.cpp \
+    copyjournal.cpp dirwatcher.cpp perftrace.cpp
+HEADERS += filemodel.h fileinfo.h engine.h fileworker.h globals.h \
+    filedata.h dirworker.h copyqueue.h dirsizeservice.h \
+    metadatacache.h thumbnailservice.h thumbnailprovider.h \
+    searchworker.h searchmodel.h fileindex.h consolemodel.h \
+    commandrunner.h crc32c.h checksumworker.h \
+    copyjournal.h dirwatcher.h perftrace.h
 
 OTHER_FILES = \
 # You DO NOT want .yaml be listed here as Qt Creator's editor is completely not ready for multi package .yaml's
@@ -43,7 +56,13 @@ OTHER_FILES = \
     qml/pages/DirectoryPage.qml \
     qml/pages/FilePage.qml \
     qml/pages/AboutPage.qml \
+    qml/pages/SearchPage.qml \
+    qml/pages/ConsolePage.qml \
+    qml/pages/DebugPage.qml \
     qml/main.qml \
     qml/functions.js
 
 INCLUDEPATH += $$PWD
+
+# 64-bit file offsets for the native file access code (files over 2 GB)
+DEFINES += _FILE_OFFSET_BITS=64
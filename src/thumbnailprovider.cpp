@@ -0,0 +1,24 @@
+#include "thumbnailprovider.h"
+#include <QImageReader>
+#include <QUrl>
+#include "thumbnailservice.h"
+
+ThumbnailProvider::ThumbnailProvider() :
+    QQuickImageProvider(QQuickImageProvider::Image)
+{
+}
+
+QImage ThumbnailProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize)
+{
+    // only reads the cached thumbnail, it is small, so this is cheap
+    QString path = QUrl::fromPercentEncoding(id.toUtf8());
+    QImageReader reader(ThumbnailService::cachePath(path), "png");
+    QSize imageSize = reader.size();
+    if (requestedSize.isValid() && imageSize.isValid())
+        reader.setScaledSize(imageSize.scaled(requestedSize, Qt::KeepAspectRatioByExpanding));
+
+    QImage image = reader.read();
+    if (size)
+        *size = image.size();
+    return image;
+}
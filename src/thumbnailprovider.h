@@ -0,0 +1,18 @@
+#ifndef THUMBNAILPROVIDER_H
+#define THUMBNAILPROVIDER_H
+
+#include <QQuickImageProvider>
+
+/**
+ * @brief ThumbnailProvider gives QML images the thumbnails created by ThumbnailService.
+ * The image id is the percent encoded path of the file.
+ */
+class ThumbnailProvider : public QQuickImageProvider
+{
+public:
+    ThumbnailProvider();
+
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize);
+};
+
+#endif // THUMBNAILPROVIDER_H
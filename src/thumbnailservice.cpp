@@ -0,0 +1,202 @@
+#include "thumbnailservice.h"
+#include <QCoreApplication>
+#include <QThread>
+#include <QMutexLocker>
+#include <QImage>
+#include <QImageReader>
+#include <QFile>
+#include <QDir>
+#include <QUrl>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+
+// size of the "normal" thumbnails of the freedesktop.org thumbnail specification
+static const int ThumbnailSize = 128;
+static const int ThumbnailThreads = 2;
+// requests waiting, older ones are for rows which have been scrolled away
+static const int MaxQueuedRequests = 64;
+
+static ThumbnailService *s_instance = 0;
+
+static QString thumbnailDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+            "/thumbnails/normal";
+}
+
+/**
+ * @brief ThumbnailThread creates thumbnails until the service is stopped.
+ */
+class ThumbnailThread : public QThread
+{
+public:
+    ThumbnailThread(ThumbnailService *service) : m_service(service) {}
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        ThumbnailService::Request request;
+        while (m_service->takeRequest(request)) {
+            bool ok = m_service->createThumbnail(request);
+            emit m_service->thumbnailDone(request.path, request.modified, ok);
+        }
+    }
+
+private:
+    ThumbnailService *m_service;
+};
+
+ThumbnailService *ThumbnailService::instance()
+{
+    // the application owns it, so the threads are stopped when the application quits
+    if (!s_instance)
+        s_instance = new ThumbnailService(QCoreApplication::instance());
+    return s_instance;
+}
+
+ThumbnailService::ThumbnailService(QObject *parent) :
+    QObject(parent),
+    m_stopping(false)
+{
+    // queued to the gui thread, where the results are used
+    connect(this, SIGNAL(thumbnailDone(QString, qint64, bool)),
+            this, SLOT(storeResult(QString, qint64, bool)), Qt::QueuedConnection);
+
+    QDir().mkpath(thumbnailDir());
+    QFile::setPermissions(thumbnailDir(), QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+
+    for (int i = 0; i < ThumbnailThreads; ++i) {
+        ThumbnailThread *thread = new ThumbnailThread(this);
+        thread->start(QThread::LowPriority);
+        m_threads.append(thread);
+    }
+}
+
+ThumbnailService::~ThumbnailService()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_requests.clear();
+        m_requestAdded.wakeAll();
+    }
+    foreach (ThumbnailThread *thread, m_threads) {
+        thread->wait();
+        delete thread;
+    }
+    s_instance = 0;
+}
+
+bool ThumbnailService::isReady(QString path, qint64 modified) const
+{
+    QHash<QString, Result>::const_iterator it = m_results.constFind(path);
+    return it != m_results.constEnd() && it.value().ok && it.value().modified == modified;
+}
+
+void ThumbnailService::request(QString path, qint64 modified)
+{
+    // failed files are tried again only if they have been modified
+    QHash<QString, Result>::const_iterator it = m_results.constFind(path);
+    if (it != m_results.constEnd() && it.value().modified == modified)
+        return;
+
+    // the thumbnail cache itself is not thumbnailed
+    if (path.startsWith(thumbnailDir()))
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    for (int i = m_requests.count() - 1; i >= 0; --i) {
+        if (m_requests.at(i).path == path) {
+            // the row is shown again, so handle it sooner
+            m_requests.move(i, m_requests.count() - 1);
+            return;
+        }
+    }
+
+    Request request;
+    request.path = path;
+    request.modified = modified;
+    m_requests.append(request);
+    if (m_requests.count() > MaxQueuedRequests)
+        m_requests.removeFirst();
+    m_requestAdded.wakeOne();
+}
+
+void ThumbnailService::cancel(QString path)
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < m_requests.count(); ++i) {
+        if (m_requests.at(i).path == path) {
+            m_requests.removeAt(i);
+            return;
+        }
+    }
+}
+
+QString ThumbnailService::cachePath(QString path)
+{
+    // the name is the md5 of the file uri, as in the freedesktop.org thumbnail specification
+    QByteArray uri = QUrl::fromLocalFile(path).toEncoded();
+    QByteArray md5 = QCryptographicHash::hash(uri, QCryptographicHash::Md5).toHex();
+    return thumbnailDir() + "/" + QString::fromLatin1(md5) + ".png";
+}
+
+void ThumbnailService::storeResult(QString path, qint64 modified, bool ok)
+{
+    Result result;
+    result.modified = modified;
+    result.ok = ok;
+    m_results.insert(path, result);
+    if (ok)
+        emit thumbnailReady(path);
+}
+
+bool ThumbnailService::takeRequest(Request &request)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_requests.isEmpty() && !m_stopping)
+        m_requestAdded.wait(&m_mutex);
+
+    if (m_stopping)
+        return false;
+
+    request = m_requests.takeLast();
+    return true;
+}
+
+bool ThumbnailService::createThumbnail(const Request &request)
+{
+    // an existing thumbnail is used if it was made of this version of the file
+    QString mtime = QString::number(request.modified);
+    QString thumbnail = cachePath(request.path);
+    QImageReader cached(thumbnail, "png");
+    if (cached.canRead() && cached.text("Thumb::MTime") == mtime)
+        return true;
+
+    // decode directly to the thumbnail size, readers like jpeg scale while decoding
+    QImageReader reader(request.path);
+    QSize size = reader.size();
+    if (size.isValid() && (size.width() > ThumbnailSize || size.height() > ThumbnailSize))
+        reader.setScaledSize(size.scaled(ThumbnailSize, ThumbnailSize, Qt::KeepAspectRatio));
+
+    QImage image = reader.read();
+    if (image.isNull())
+        return false;
+
+    // readers which can't scale while decoding give the full size
+    if (image.width() > ThumbnailSize || image.height() > ThumbnailSize)
+        image = image.scaled(ThumbnailSize, ThumbnailSize, Qt::KeepAspectRatio,
+                             Qt::SmoothTransformation);
+
+    image.setText("Thumb::URI", QString::fromLatin1(QUrl::fromLocalFile(request.path).toEncoded()));
+    image.setText("Thumb::MTime", mtime);
+
+    // written to a temporary file first, so other readers never see a partial thumbnail
+    QString tmp = thumbnail + "." + QString::number((quintptr)QThread::currentThreadId()) +
+            ".tmp";
+    if (!image.save(tmp, "PNG"))
+        return false;
+    QFile::setPermissions(tmp, QFile::ReadOwner | QFile::WriteOwner);
+    QFile::remove(thumbnail);
+    return QFile::rename(tmp, thumbnail);
+}
@@ -0,0 +1,73 @@
+#ifndef THUMBNAILSERVICE_H
+#define THUMBNAILSERVICE_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QList>
+
+class ThumbnailThread;
+
+/**
+ * @brief ThumbnailService creates thumbnails of images with a small pool of threads.
+ * Thumbnails are stored in the freedesktop.org thumbnail cache (~/.cache/thumbnails/normal),
+ * so they are shared with other applications and a folder shown again needs no decoding.
+ * Images are decoded with QImageReader::setScaledSize(), so JPEGs are not decoded in full size.
+ * The latest requests are handled first, because they are for the rows being shown. Only the
+ * latest requests are kept and older ones are dropped, they are made again if the rows are
+ * shown again. The results are used only in the gui thread.
+ */
+class ThumbnailService : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ThumbnailService *instance();
+    ~ThumbnailService();
+
+    // true if the thumbnail exists for this modification time (seconds)
+    bool isReady(QString path, qint64 modified) const;
+
+    // starts creating the thumbnail, thumbnailReady() is emitted when it exists
+    void request(QString path, qint64 modified);
+    void cancel(QString path);
+
+    // path of the thumbnail in the cache, can be called from any thread
+    static QString cachePath(QString path);
+
+signals:
+    void thumbnailReady(QString path);
+
+    // emitted in the pool threads
+    void thumbnailDone(QString path, qint64 modified, bool ok);
+
+private slots:
+    void storeResult(QString path, qint64 modified, bool ok);
+
+private:
+    friend class ThumbnailThread;
+
+    struct Request {
+        QString path;
+        qint64 modified;
+    };
+    struct Result {
+        qint64 modified;
+        bool ok; // false if the file could not be decoded, so it is not tried again
+    };
+
+    explicit ThumbnailService(QObject *parent = 0);
+    bool takeRequest(Request &request);
+    bool createThumbnail(const Request &request);
+
+    QHash<QString, Result> m_results;
+
+    QMutex m_mutex; // protects the request members below
+    QWaitCondition m_requestAdded;
+    QList<Request> m_requests; // the latest last
+    bool m_stopping;
+    QList<ThumbnailThread *> m_threads;
+};
+
+#endif // THUMBNAILSERVICE_H
@@ -0,0 +1,408 @@
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QEventLoop>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include "filemodel.h"
+#include "fileworker.h"
+#include "metadatacache.h"
+#include "fileindex.h"
+#include "dirwatcher.h"
+#include "dirsizeservice.h"
+#include "thumbnailservice.h"
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// sizes of the synthetic trees
+static const int SmallFileSize = 1024;
+static const int DeepTreeDepth = 64;
+static const int DeepTreeFilesPerDir = 16;
+static const int LargeFileCount = 2;
+static const qint64 DefaultLargeFileMB = 64;
+// calls of data() per benchmark iteration, spread over the rows
+static const int RoleCalls = 1000;
+// longest wait for an operation to complete (milliseconds)
+static const int Timeout = 10 * 60 * 1000;
+
+// the limits are generous, they catch regressions like a listing stat-ing in the gui thread
+static const int MaxListingMsPer10k = 3000;
+static const int MaxBytesPerRow = 2048;
+static const int MaxDataNs = 20000;
+static const double MinCopyMBps = 1.0;
+
+// runs the event loop until the object emits the signal or the timeout expires
+static bool waitForSignal(QObject *object, const char *signal, int timeout)
+{
+    QEventLoop loop;
+    QTimer timer;
+    timer.setSingleShot(true);
+    QObject::connect(object, signal, &loop, SLOT(quit()));
+    QObject::connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+    timer.start(timeout);
+    loop.exec();
+    return timer.isActive();
+}
+
+static bool waitForListing(FileModel *model)
+{
+    while (model->loading()) {
+        if (!waitForSignal(model, SIGNAL(loadingChanged()), Timeout))
+            return false;
+    }
+    return true;
+}
+
+static qint64 allocatedBytes()
+{
+    // the fields of mallinfo() are ints, which wrap above 2 GB
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return (qint64)mallinfo2().uordblks;
+#else
+    return (qint64)(unsigned int)mallinfo().uordblks;
+#endif
+}
+
+/**
+ * @brief Benchmarks measures the performance of the file model and file operations.
+ * Synthetic trees are created in the directory given by FILE_BROWSER_BENCHMARK_DIR, the
+ * default is in the test cache directory, so on a device they are on the flash and not on tmpfs.
+ * It also checks that the listing snapshot saved at exit is replaced by the next one.
+ * FILE_BROWSER_BENCHMARK_LARGE_MB sets the size of the large files (0 leaves them out).
+ */
+class Benchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void listing_data();
+    void listing();
+    void listingCached_data();
+    void listingCached();
+    void memoryPerRow();
+    void modelData_data();
+    void modelData();
+    void copy_data();
+    void copy();
+    void deleteFiles_data();
+    void deleteFiles();
+    void snapshotSavedTwice();
+
+    void setWorkerError(QString message, QString filename);
+
+private:
+    bool createFiles(QString dir, int count, int size);
+    bool createDeepTree(QString dir, int depth, int filesPerDir);
+    bool createLargeFile(QString filename, qint64 size);
+    bool copyToDir(QString src, QString dest);
+
+    QString m_root;
+    qint64 m_largeFileSize;
+    QString m_workerError;
+};
+
+void Benchmarks::initTestCase()
+{
+    // the snapshot and the index go to the test cache directory, not to the user's
+    QStandardPaths::setTestModeEnabled(true);
+
+    // the shared services are created in the gui thread before the workers use them
+    FileIndex::instance();
+    DirWatcher::instance();
+    DirSizeService::instance();
+    ThumbnailService::instance();
+
+    m_root = QString::fromLocal8Bit(qgetenv("FILE_BROWSER_BENCHMARK_DIR"));
+    if (m_root.isEmpty()) {
+        m_root = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+                "/harbour-file-browser-benchmark";
+    }
+    QByteArray largeMB = qgetenv("FILE_BROWSER_BENCHMARK_LARGE_MB");
+    m_largeFileSize = (largeMB.isEmpty() ? DefaultLargeFileMB : largeMB.toLongLong()) * 1024 * 1024;
+
+    QDir(m_root).removeRecursively();
+    QVERIFY2(createFiles(m_root + "/small10k", 10000, SmallFileSize) &&
+             createFiles(m_root + "/small100k", 100000, SmallFileSize) &&
+             createDeepTree(m_root + "/deep", DeepTreeDepth, DeepTreeFilesPerDir) &&
+             QDir().mkpath(m_root + "/large"),
+             qPrintable("Can't create the test files in " + m_root));
+    for (int i = 0; m_largeFileSize > 0 && i < LargeFileCount; ++i) {
+        QVERIFY(createLargeFile(QString("%1/large/file%2.bin").arg(m_root).arg(i),
+                                m_largeFileSize));
+    }
+}
+
+void Benchmarks::cleanupTestCase()
+{
+    QDir(m_root).removeRecursively();
+}
+
+void Benchmarks::listing_data()
+{
+    QTest::addColumn<QString>("dir");
+    QTest::addColumn<int>("count");
+    QTest::newRow("10k files") << "small10k" << 10000;
+    QTest::newRow("100k files") << "small100k" << 100000;
+}
+
+void Benchmarks::listing()
+{
+    // from the disk or the kernel caches, the listing cache is cleared for every read
+    QFETCH(QString, dir);
+    QFETCH(int, count);
+    QString path = m_root + "/" + dir;
+
+    QElapsedTimer timer;
+    timer.start();
+    int rounds = 0;
+    QBENCHMARK {
+        MetadataCache::instance()->invalidate(path);
+        FileModel model;
+        model.setActive(true);
+        model.setDir(path);
+        QVERIFY(waitForListing(&model));
+        QCOMPARE(model.rowCount(), count);
+        ++rounds;
+    }
+    QVERIFY(timer.elapsed() / rounds < (qint64)MaxListingMsPer10k * count / 10000);
+}
+
+void Benchmarks::listingCached_data()
+{
+    listing_data();
+}
+
+void Benchmarks::listingCached()
+{
+    // the rows come from the listing cache, the refresh after them stats the entries again
+    QFETCH(QString, dir);
+    QFETCH(int, count);
+    QString path = m_root + "/" + dir;
+    {
+        FileModel model;
+        model.setActive(true);
+        model.setDir(path);
+        QVERIFY(waitForListing(&model));
+    }
+
+    QBENCHMARK {
+        FileModel model;
+        model.setActive(true);
+        model.setDir(path);
+        QCOMPARE(model.rowCount(), count);
+        QVERIFY(waitForListing(&model));
+    }
+}
+
+void Benchmarks::memoryPerRow()
+{
+    QString path = m_root + "/small10k";
+    MetadataCache::instance()->invalidate(path);
+    qint64 before = allocatedBytes();
+    FileModel model;
+    model.setActive(true);
+    model.setDir(path);
+    QVERIFY(waitForListing(&model));
+    QVERIFY(model.rowCount() > 0);
+
+    qint64 bytesPerRow = (allocatedBytes() - before) / model.rowCount();
+    QTest::setBenchmarkResult(bytesPerRow, QTest::BytesAllocated);
+    QVERIFY(bytesPerRow < MaxBytesPerRow);
+}
+
+void Benchmarks::modelData_data()
+{
+    QTest::addColumn<QByteArray>("role");
+    QTest::addColumn<bool>("withStat");
+    FileModel model;
+    QHash<int, QByteArray> roles = model.roleNames();
+    foreach (const QByteArray &role, roles) {
+        QTest::newRow(role.constData()) << role << false;
+        QTest::newRow((role + " with stat").constData()) << role << true;
+    }
+}
+
+void Benchmarks::modelData()
+{
+    QFETCH(QByteArray, role);
+    QFETCH(bool, withStat);
+
+    FileModel model;
+    model.setActive(true);
+    model.setDir(m_root + "/small10k");
+    QVERIFY(waitForListing(&model));
+    int rows = model.rowCount();
+    QVERIFY(rows > 0);
+    int roleId = model.roleNames().key(role);
+
+    // the first calls request the stats, then the texts are there
+    if (withStat) {
+        for (int i = 0; i < rows; ++i)
+            model.data(model.index(i), roleId);
+        QElapsedTimer wait;
+        wait.start();
+        while (wait.elapsed() < 2000)
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 calls = 0;
+    QBENCHMARK {
+        for (int i = 0; i < RoleCalls; ++i)
+            model.data(model.index(i % rows), roleId);
+        calls += RoleCalls;
+    }
+    QVERIFY(timer.nsecsElapsed() / calls < MaxDataNs);
+}
+
+void Benchmarks::copy_data()
+{
+    QTest::addColumn<QString>("dir");
+    QTest::addColumn<qint64>("bytes");
+    QTest::newRow("10k small files") << "small10k" << (qint64)10000 * SmallFileSize;
+    QTest::newRow("deep tree") << "deep" <<
+                                  (qint64)DeepTreeDepth * DeepTreeFilesPerDir * SmallFileSize;
+    if (m_largeFileSize > 0)
+        QTest::newRow("large files") << "large" << LargeFileCount * m_largeFileSize;
+}
+
+void Benchmarks::copy()
+{
+    QFETCH(QString, dir);
+    QFETCH(qint64, bytes);
+    QString dest = m_root + "/copies";
+    QDir(dest).removeRecursively();
+
+    // the throughput includes writing the data to the disk, like on a real device
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(copyToDir(m_root + "/" + dir, dest));
+    sync();
+    qint64 elapsed = qMax(timer.elapsed(), (qint64)1);
+
+    double bytesPerSecond = bytes * 1000.0 / elapsed;
+    QTest::setBenchmarkResult(bytesPerSecond, QTest::BytesPerSecond);
+    QVERIFY(bytesPerSecond / (1024 * 1024) > MinCopyMBps);
+    QDir(dest).removeRecursively();
+}
+
+void Benchmarks::deleteFiles_data()
+{
+    copy_data();
+}
+
+void Benchmarks::deleteFiles()
+{
+    // the copy is made first and only deleting it is measured
+    QFETCH(QString, dir);
+    QString dest = m_root + "/copies";
+    QDir(dest).removeRecursively();
+    QVERIFY(copyToDir(m_root + "/" + dir, dest));
+    sync();
+
+    FileWorker worker;
+    connect(&worker, SIGNAL(errorOccurred(QString, QString, bool)),
+            this, SLOT(setWorkerError(QString, QString)));
+    m_workerError.clear();
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(worker.startDeleteFiles(QStringList() << dest + "/" + dir));
+    QVERIFY(waitForSignal(&worker, SIGNAL(finished()), Timeout));
+    QTest::setBenchmarkResult(timer.elapsed(), QTest::WalltimeMilliseconds);
+    QVERIFY2(m_workerError.isEmpty(), qPrintable(m_workerError));
+    QDir(dest).removeRecursively();
+}
+
+void Benchmarks::snapshotSavedTwice()
+{
+    // a saved snapshot is replaced by the next one
+    MetadataCache *cache = MetadataCache::instance();
+    cache->setLastDir(m_root + "/small10k");
+    cache->saveSnapshot();
+    cache->setLastDir(m_root + "/deep");
+    cache->saveSnapshot();
+    QCOMPARE(cache->loadSnapshot(), QDir::cleanPath(m_root + "/deep"));
+}
+
+void Benchmarks::setWorkerError(QString message, QString filename)
+{
+    m_workerError = message + " " + filename;
+}
+
+bool Benchmarks::copyToDir(QString src, QString dest)
+{
+    if (!QDir().mkpath(dest))
+        return false;
+
+    FileWorker worker;
+    connect(&worker, SIGNAL(errorOccurred(QString, QString, bool)),
+            this, SLOT(setWorkerError(QString, QString)));
+    m_workerError.clear();
+    if (!worker.startCopyFiles(QStringList() << src, dest) ||
+            !waitForSignal(&worker, SIGNAL(finished()), Timeout))
+        return false;
+    if (!m_workerError.isEmpty()) {
+        qWarning("%s", qPrintable(m_workerError));
+        return false;
+    }
+    return true;
+}
+
+bool Benchmarks::createFiles(QString dir, int count, int size)
+{
+    if (!QDir().mkpath(dir))
+        return false;
+
+    QByteArray data(size, 'x');
+    for (int i = 0; i < count; ++i) {
+        QFile file(QString("%1/file%2.txt").arg(dir).arg(i));
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != size)
+            return false;
+    }
+    return true;
+}
+
+bool Benchmarks::createDeepTree(QString dir, int depth, int filesPerDir)
+{
+    // each level has its files and the next level
+    QString path = dir;
+    for (int level = 0; level < depth; ++level) {
+        if (!createFiles(path, filesPerDir, SmallFileSize))
+            return false;
+        path += QString("/level%1").arg(level + 1);
+    }
+    return true;
+}
+
+bool Benchmarks::createLargeFile(QString filename, qint64 size)
+{
+    // real data, holes would make the copy faster than it is for real files
+    int fd = open(QFile::encodeName(filename).constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+    for (int i = 0; i < buffer.size(); ++i)
+        buffer[i] = (char)(i * 31 + i / 4096);
+
+    qint64 written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, buffer.constData(), (size_t)qMin((qint64)buffer.size(), size - written));
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        written += n;
+    }
+    return close(fd) == 0;
+}
+
+QTEST_MAIN(Benchmarks)
+
+#include "benchmarks.moc"
@@ -0,0 +1,24 @@
+TEMPLATE = app
+TARGET = benchmarks
+
+# performance benchmarks of the model and file operations, run with "make check"
+# they fail on big regressions, see the limits in benchmarks.cpp
+QT += testlib gui
+QT -= widgets
+CONFIG += testcase
+
+SRCDIR = ../src
+INCLUDEPATH += $$SRCDIR
+
+SOURCES += benchmarks.cpp \
+    $$SRCDIR/filemodel.cpp $$SRCDIR/fileworker.cpp $$SRCDIR/globals.cpp \
+    $$SRCDIR/filedata.cpp $$SRCDIR/dirworker.cpp $$SRCDIR/copyqueue.cpp \
+    $$SRCDIR/dirsizeservice.cpp $$SRCDIR/metadatacache.cpp $$SRCDIR/thumbnailservice.cpp \
+    $$SRCDIR/searchworker.cpp $$SRCDIR/fileindex.cpp $$SRCDIR/crc32c.cpp \
+    $$SRCDIR/copyjournal.cpp $$SRCDIR/dirwatcher.cpp $$SRCDIR/perftrace.cpp
+HEADERS += \
+    $$SRCDIR/filemodel.h $$SRCDIR/fileworker.h $$SRCDIR/globals.h \
+    $$SRCDIR/filedata.h $$SRCDIR/dirworker.h $$SRCDIR/copyqueue.h \
+    $$SRCDIR/dirsizeservice.h $$SRCDIR/metadatacache.h $$SRCDIR/thumbnailservice.h \
+    $$SRCDIR/searchworker.h $$SRCDIR/fileindex.h $$SRCDIR/crc32c.h \
+    $$SRCDIR/copyjournal.h $$SRCDIR/dirwatcher.h $$SRCDIR/perftrace.h